@@ -0,0 +1,264 @@
+/* Benchmark suite for the converter. For every GLB given on the command
+ * line it measures
+ *
+ *    - JSON chunk parse throughput (gJSON_ParseLazy, what the
+ *      conversion does)                                     MB/s
+ *    - the same for a whole tree (gJSON_ParseWithLength) and the tape
+ *      (gJSON_TapeParse), and the bytes both keep
+ *    - accessor extraction throughput                       GB/s
+ *    - conversion from memory and end to end (read + convert + write) ms
+ *    - allocations made by one conversion and peak RSS
+ *
+ * and prints one JSON object per file so results can be tracked over time.
+ *
+ *    bench [-n iterations] file.glb ...
+ *
+ * Allocations are counted by the malloc/calloc/realloc/free wrappers of
+ * src/wrap.c, linked in with ALLOC_WRAP (see the Makefile). */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "glb.h"
+#include "fgm.h"
+#include "gjson.h"
+#include "stats.h"
+
+static uint64_t allocations(void)
+{
+    uint64_t count;
+    FGM_StatsAllocations(&count, NULL, NULL);
+    return count;
+}
+
+static uint64_t frees(void)
+{
+    uint64_t count;
+    FGM_StatsAllocations(NULL, &count, NULL);
+    return count;
+}
+
+static uint64_t allocated_bytes(void)
+{
+    uint64_t bytes;
+    FGM_StatsAllocations(NULL, NULL, &bytes);
+    return bytes;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void print_string(const char *text)
+{
+    /* text as a JSON string, quotes and control characters escaped */
+
+    putchar('"');
+
+    for (const unsigned char *c = (const unsigned char*)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\')
+            printf("\\%c", *c);
+        else if (*c < 0x20)
+            printf("\\u%04x", *c);
+        else
+            putchar(*c);
+    }
+
+    putchar('"');
+}
+
+static int bench_file(const char *path, int iterations)
+{
+    size_t size = 0;
+    unsigned char *data;
+    uint32_t json_length;
+    double start, elapsed, best_read = 1e9, best_parse = 1e9, best_eager = 1e9, best_tape = 1e9, best_convert = 1e9, best_total = 1e9;
+    uint64_t start_allocations, start_bytes, start_frees;
+    uint64_t extracted = 0;
+    uint64_t tree_bytes = 0, tape_bytes = 0;
+    uint16_t num_meshes = 0;
+    long rss;
+    char out[4096];
+
+    snprintf(out, sizeof(out), "%s.fgm", path);
+
+    /* one untimed conversion for allocation counts and peak RSS, before the
+     * timed loops leave their garbage around */
+    {
+        struct GLB_Meshes meshes;
+
+        start_allocations = allocations();
+        start_bytes = allocated_bytes();
+        start_frees = frees();
+
+        data = FGM_ReadFile(path, &size);
+        if (data == NULL || !GLB_Decode(&meshes, data, size, NULL)) {
+            printf("bench : could not convert %s\n", path);
+            free(data);
+            return 0;
+        }
+
+        extracted = meshes.length;
+        num_meshes = meshes.num_meshes;
+        rss = peak_rss_kb();
+
+        GLB_FreeMeshes(&meshes);
+        free(data);
+    }
+
+    uint64_t conversion_allocations = allocations() - start_allocations;
+    uint64_t conversion_bytes = allocated_bytes() - start_bytes;
+    uint64_t conversion_frees = frees() - start_frees;
+
+    for (int i = 0; i < iterations; i++) {
+        /* file read alone */
+        start = now();
+        data = FGM_ReadFile(path, &size);
+        elapsed = now() - start;
+        if (elapsed < best_read)
+            best_read = elapsed;
+
+        if (data == NULL || size < 20) {
+            printf("bench : could not read %s\n", path);
+            free(data);
+            return 0;
+        }
+
+        /* JSON chunk alone, it starts right after the 12 byte header and 8 byte chunk header */
+        memcpy(&json_length, data + 12, sizeof(uint32_t));
+
+        start = now();
+        gJSON *gson = gJSON_ParseLazy(data + 20, json_length);
+        elapsed = now() - start;
+        if (elapsed < best_parse)
+            best_parse = elapsed;
+
+        gJSON_Delete(gson);
+
+        start = now();
+        gson = gJSON_ParseWithLength(data + 20, json_length);
+        elapsed = now() - start;
+        if (elapsed < best_eager)
+            best_eager = elapsed;
+
+        /* what the tree keeps alive, the allocations of one parse */
+        if (i == 0) {
+            start_bytes = allocated_bytes();
+            gJSON_Delete(gson);
+            gson = gJSON_ParseWithLength(data + 20, json_length);
+            tree_bytes = allocated_bytes() - start_bytes;
+        }
+
+        gJSON_Delete(gson);
+
+        gJSON_Tape tape;
+
+        start = now();
+        int parsed = gJSON_TapeParse(&tape, data + 20, json_length);
+        elapsed = now() - start;
+        if (elapsed < best_tape)
+            best_tape = elapsed;
+
+        if (parsed)
+            tape_bytes = gJSON_TapeSize(&tape);
+        gJSON_TapeFree(&tape);
+        free(data);
+
+        /* end to end on its own, read then conversion from memory then
+         * serializing and writing */
+        struct GLB_Meshes meshes;
+        double total_start = now();
+
+        data = FGM_ReadFile(path, &size);
+
+        start = now();
+        int decoded = data != NULL && GLB_Decode(&meshes, data, size, NULL);
+        elapsed = now() - start;
+
+        if (!decoded) {
+            printf("bench : could not convert %s\n", path);
+            free(data);
+            return 0;
+        }
+
+        if (elapsed < best_convert)
+            best_convert = elapsed;
+
+        unsigned char *fgm = malloc(FGM_Size(&meshes));
+        size_t fgm_length = FGM_Write(&meshes, fgm);
+        FILE *fp = fopen(out, "wb");
+
+        if (fp != NULL) {
+            fwrite(fgm, fgm_length, 1, fp);
+            fclose(fp);
+        }
+
+        elapsed = now() - total_start;
+        if (elapsed < best_total)
+            best_total = elapsed;
+
+        free(fgm);
+        GLB_FreeMeshes(&meshes);
+        free(data);
+    }
+
+    remove(out);
+
+    /* extraction is whatever the conversion spends beyond the lazy parse it
+     * starts with, the nested objects parsed on first access included */
+    double extract = best_convert - best_parse;
+    if (extract <= 0)
+        extract = 1e-9;
+
+    printf("{\"file\":");
+    print_string(path);
+    printf(",\"bytes\":%lu,\"json_bytes\":%u,\"meshes\":%u,\"extracted_bytes\":%lu,"
+           "\"iterations\":%d,\"read_ms\":%.3f,\"parse_ms\":%.3f,\"parse_mbps\":%.2f,"
+           "\"eager_parse_ms\":%.3f,\"eager_parse_mbps\":%.2f,"
+           "\"tape_ms\":%.3f,\"tape_mbps\":%.2f,\"tree_bytes\":%lu,\"tape_bytes\":%lu,"
+           "\"extract_ms\":%.3f,\"extract_gbps\":%.3f,\"convert_ms\":%.3f,\"end_to_end_ms\":%.3f,"
+           "\"allocations\":%lu,\"frees\":%lu,\"allocated_bytes\":%lu,\"peak_rss_kb\":%ld}\n",
+           (unsigned long)size, json_length, num_meshes, (unsigned long)extracted, iterations,
+           best_read*1e3, best_parse*1e3, json_length/best_parse/1e6,
+           best_eager*1e3, json_length/best_eager/1e6,
+           best_tape*1e3, json_length/best_tape/1e6, (unsigned long)tree_bytes, (unsigned long)tape_bytes,
+           extract*1e3, extracted/extract/1e9,
+           best_convert*1e3, best_total*1e3, (unsigned long)conversion_allocations,
+           (unsigned long)conversion_frees, (unsigned long)conversion_bytes, rss);
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = 5;
+    int status = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+            continue;
+        }
+
+        if (!bench_file(argv[i], iterations > 0 ? iterations : 1))
+            status = 1;
+    }
+
+    return status;
+}
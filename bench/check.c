@@ -0,0 +1,1937 @@
+/* Behaviour checks of the converter. Converts GLB files made by glbgen in
+ * memory with the flags of every check that applies to them, decodes the
+ * output and compares it against the GLB itself and against the known
+ * values listed at the top of glbgen.c. The parser checks run once before
+ * the files, on documents written in this file
+ *
+ *    check file.glb...
+ *
+ * Prints one line per check and exits with 1 when any of them failed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <float.h>
+
+#include "fgm.h"
+#include "glb.h"
+#include "gjson.h"
+#include "anim.h"
+#include "bvh.h"
+#include "tangent.h"
+#include "flatten.h"
+#include "texture.h"
+#include "morph.h"
+#include "stats.h"
+
+typedef struct
+{
+    const char *path;
+    unsigned char *data;
+    size_t length;
+    gJSON *json;
+    const unsigned char *bin;
+    size_t bin_length;
+} Glb;
+
+typedef struct
+{
+    unsigned char *data;
+    size_t length;
+    int num_meshes;
+    size_t buffer;       /* offset of the mesh buffer */
+    size_t buffer_end;
+    size_t sections;     /* offset of the first section header, 0 without sections */
+    uint32_t num_sections;
+} Fgm;
+
+static const char *current_check;
+static const char *current_file;
+static int failures;
+
+static int fail(const char *fmt, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "check : %s %s : ", current_file, current_check);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+
+    failures++;
+    return 0;
+}
+
+static uint32_t read_u32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int32_t read_i32(const unsigned char *p)
+{
+    int32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read_u64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static float read_f32(const unsigned char *p)
+{
+    float value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int get_int(gJSON *object, const char *name, int fallback)
+{
+    gJSON *item = gJSON_GetObjectItem(object, name);
+    return item != NULL ? item->valueint : fallback;
+}
+
+static int count_items(gJSON *array)
+{
+    int count = 0;
+
+    for (gJSON *item = gJSON_GetArrayItem(array, 0); item != NULL; item = item->next)
+        count++;
+
+    return count;
+}
+
+static int load_glb(Glb *glb, const char *path)
+{
+    memset(glb, 0, sizeof(Glb));
+    glb->path = path;
+    glb->data = FGM_ReadFile(path, &glb->length);
+
+    if (glb->data == NULL || glb->length < 28 || !GLB_CheckHeader(glb->data))
+        return 0;
+
+    uint32_t json_length = read_u32(glb->data + 12);
+    if (json_length > glb->length - 28)
+        return 0;
+
+    glb->json = gJSON_ParseWithLength(glb->data + 20, json_length);
+    glb->bin = glb->data + 28 + json_length;
+    glb->bin_length = read_u32(glb->data + 20 + json_length);
+
+    return glb->json != NULL && glb->bin_length <= glb->length - 28 - json_length;
+}
+
+static void free_glb(Glb *glb)
+{
+    gJSON_Delete(glb->json);
+    free(glb->data);
+}
+
+static unsigned char *read_accessor(const Glb *glb, int index, size_t *element_size, int *count)
+{
+    /* tightly packed copy of an accessor, read independently of accessor.c */
+
+    gJSON *accessor = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "accessors"), index);
+    gJSON *view = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "bufferViews"),
+                                     get_int(accessor, "bufferView", -1));
+    gJSON *type = gJSON_GetObjectItem(accessor, "type");
+    static const char *types[] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+    static const int components[] = { 1, 2, 3, 4, 4, 9, 16 };
+    int component_size, n = 0;
+
+    if (view == NULL || type == NULL || type->valuestring == NULL)
+        return NULL;
+
+    switch (get_int(accessor, "componentType", 0)) {
+        case 5120: case 5121: component_size = 1; break;
+        case 5122: case 5123: component_size = 2; break;
+        case 5125: case 5126: component_size = 4; break;
+        default: return NULL;
+    }
+
+    for (int i = 0; i < 7; i++) {
+        if (strcmp(type->valuestring, types[i]) == 0)
+            n = components[i];
+    }
+
+    *count = get_int(accessor, "count", 0);
+    *element_size = (size_t)component_size*n;
+
+    size_t stride = (size_t)get_int(view, "byteStride", 0);
+    size_t offset = (size_t)get_int(view, "byteOffset", 0) + (size_t)get_int(accessor, "byteOffset", 0);
+
+    if (stride == 0)
+        stride = *element_size;
+
+    if (n == 0 || *count <= 0 || offset + stride*(*count - 1) + *element_size > glb->bin_length)
+        return NULL;
+
+    unsigned char *data = malloc(*element_size*(*count));
+    for (int i = 0; data != NULL && i < *count; i++)
+        memcpy(data + *element_size*i, glb->bin + offset + stride*i, *element_size);
+
+    return data;
+}
+
+static int convert(const Glb *glb, uint32_t flags, Fgm *fgm)
+{
+    struct GLB_Options options = { flags, NULL };
+
+    memset(fgm, 0, sizeof(Fgm));
+
+    if (!FGM_Convert(glb->data, glb->length, &options, &fgm->data, &fgm->length))
+        return fail("conversion failed");
+
+    if (fgm->length < 2)
+        return fail("%lu bytes long output", (unsigned long)fgm->length);
+
+    fgm->num_meshes = fgm->data[0] | fgm->data[1] << 8;
+    fgm->buffer = 2 + 32*(size_t)fgm->num_meshes;
+    fgm->buffer_end = fgm->length;
+
+    if (fgm->buffer > fgm->length)
+        return fail("truncated header");
+
+    if (fgm->length >= 16 && memcmp(fgm->data + fgm->length - 4, FGM_SECTION_MAGIC, 4) == 0) {
+        fgm->sections = read_u64(fgm->data + fgm->length - 16);
+        fgm->num_sections = read_u32(fgm->data + fgm->length - 8);
+
+        if (fgm->sections < fgm->buffer || fgm->sections > fgm->length - 16)
+            return fail("first section at %lu", (unsigned long)fgm->sections);
+
+        /* the buffer ends with the padding before the sections */
+        fgm->buffer_end = fgm->sections;
+    }
+
+    return 1;
+}
+
+static int convert_patched(const Glb *glb, size_t offset, const void *bytes, size_t length, uint32_t flags,
+                           Glb *patched, Fgm *fgm)
+{
+    /* converts a copy of the GLB with length bytes at offset replaced, the
+     * copy is left in patched (free patched->data) */
+
+    struct GLB_Options options = { flags, NULL };
+
+    *patched = *glb;
+    memset(fgm, 0, sizeof(Fgm));
+
+    if ((patched->data = malloc(glb->length)) == NULL)
+        return fail("out of memory");
+
+    memcpy(patched->data, glb->data, glb->length);
+    memcpy(patched->data + offset, bytes, length);
+    patched->bin = patched->data + (glb->bin - glb->data);
+
+    return FGM_Convert(patched->data, patched->length, &options, &fgm->data, &fgm->length);
+}
+
+static int convert_json(const Glb *glb, const char *json, size_t json_length, uint32_t flags, Fgm *fgm)
+{
+    /* converts the GLB with its JSON chunk replaced by json, padded with
+     * spaces, and the BIN chunk kept */
+
+    struct GLB_Options options = { flags, NULL };
+    size_t old_length = read_u32(glb->data + 12);
+    size_t padded = (json_length + 3) & ~(size_t)3;
+    size_t rest = glb->length - 20 - old_length;
+    size_t length = 20 + padded + rest;
+    unsigned char *data = malloc(length);
+    uint32_t word;
+    int status;
+
+    memset(fgm, 0, sizeof(Fgm));
+
+    if (data == NULL)
+        return fail("out of memory");
+
+    memcpy(data, glb->data, 20);
+    word = (uint32_t)length;
+    memcpy(data + 8, &word, 4);
+    word = (uint32_t)padded;
+    memcpy(data + 12, &word, 4);
+    memcpy(data + 20, json, json_length);
+    memset(data + 20 + json_length, ' ', padded - json_length);
+    memcpy(data + 20 + padded, glb->data + 20 + old_length, rest);
+
+    status = FGM_Convert(data, length, &options, &fgm->data, &fgm->length);
+    free(data);
+
+    return status;
+}
+
+static const unsigned char *find_section(const Fgm *fgm, const char *tag, size_t *length)
+{
+    size_t offset = fgm->sections;
+
+    for (uint32_t s = 0; offset != 0 && s < fgm->num_sections; s++) {
+        if (offset > fgm->length - 32)
+            return NULL;
+
+        uint64_t section_length = read_u64(fgm->data + offset + 8);
+
+        if (section_length > fgm->length - 16 - offset - 16)
+            return NULL;
+
+        if (memcmp(fgm->data + offset, tag, 4) == 0) {
+            *length = (size_t)section_length;
+            return fgm->data + offset + 16;
+        }
+
+        offset += 16 + ((section_length + FGM_SECTION_ALIGN - 1) & ~(uint64_t)(FGM_SECTION_ALIGN - 1));
+    }
+
+    return NULL;
+}
+
+static const unsigned char *get_stream(const Fgm *fgm, int mesh, int stream, uint64_t *length)
+{
+    /* the STRM offsets when streams are shared, the sum of the sizes before otherwise */
+
+    size_t strm_length;
+    const unsigned char *strm = find_section(fgm, FGM_SECTION_STREAMS, &strm_length);
+    uint64_t offset = 0;
+
+    *length = read_u64(fgm->data + 2 + 32*(size_t)mesh + 8*stream);
+
+    if (strm != NULL) {
+        if (strm_length < 16 + 32*(size_t)fgm->num_meshes)
+            return NULL;
+        offset = read_u64(strm + 16 + 32*(size_t)mesh + 8*stream);
+    } else {
+        for (int i = 0; i < mesh*4 + stream; i++)
+            offset += read_u64(fgm->data + 2 + 8*(size_t)i);
+    }
+
+    if (offset > fgm->buffer_end - fgm->buffer || *length > fgm->buffer_end - fgm->buffer - offset)
+        return NULL;
+
+    return fgm->data + fgm->buffer + offset;
+}
+
+static int check_streams(const Glb *glb, const Fgm *fgm)
+{
+    /* every stream holds the bytes of the accessor it comes from */
+
+    static const char *names[4] = { "POSITION", "NORMAL", "TEXCOORD_0", NULL };
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+
+    if (fgm->num_meshes != count_items(meshes))
+        return fail("%d meshes instead of %d", fgm->num_meshes, count_items(meshes));
+
+    for (int m = 0; m < fgm->num_meshes; m++) {
+        gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, m), "primitives"), 0);
+        gJSON *attributes = gJSON_GetObjectItem(primitive, "attributes");
+
+        for (int s = 0; s < 4; s++) {
+            int index = names[s] != NULL ? get_int(attributes, names[s], -1) : get_int(primitive, "indices", -1);
+            size_t element_size;
+            int count;
+            uint64_t length;
+
+            unsigned char *expected = read_accessor(glb, index, &element_size, &count);
+            const unsigned char *stream = get_stream(fgm, m, s, &length);
+            int same = expected != NULL && stream != NULL && length == element_size*count &&
+                       memcmp(stream, expected, (size_t)length) == 0;
+
+            free(expected);
+
+            if (!same)
+                return fail("mesh %d stream %d differs from accessor %d", m, s, index);
+        }
+    }
+
+    return 1;
+}
+
+static int stream_accessor(const Glb *glb, int mesh, int stream)
+{
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+    gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, mesh), "primitives"), 0);
+    static const char *names[3] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+
+    if (stream == 3)
+        return get_int(primitive, "indices", -1);
+    return get_int(gJSON_GetObjectItem(primitive, "attributes"), names[stream], -1);
+}
+
+static void accessor_source(const Glb *glb, int index, uint64_t *source)
+{
+    /* where the elements of an accessor are : BIN offset, stride, length */
+
+    gJSON *accessor = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "accessors"), index);
+    gJSON *view = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "bufferViews"),
+                                     get_int(accessor, "bufferView", -1));
+
+    source[0] = (uint64_t)get_int(view, "byteOffset", 0) + (uint64_t)get_int(accessor, "byteOffset", 0);
+    source[1] = (uint64_t)get_int(view, "byteStride", 0);
+    source[2] = (uint64_t)get_int(accessor, "count", 0);
+}
+
+static int check_shared(const Glb *glb, const Fgm *fgm, int content)
+{
+    /* two streams are written once exactly when they read the same
+     * elements of the BIN chunk, or hold the same bytes with content */
+
+    int streams = fgm->num_meshes*4;
+    uint64_t written = 0;
+
+    if (!check_streams(glb, fgm))
+        return 0;
+
+    if (find_section(fgm, FGM_SECTION_STREAMS, &(size_t){ 0 }) == NULL)
+        return fail("no %s section", FGM_SECTION_STREAMS);
+
+    for (int a = 0; a < streams; a++) {
+        uint64_t length_a, source_a[3];
+        const unsigned char *stream_a = get_stream(fgm, a/4, a%4, &length_a);
+        int first = 1;
+
+        accessor_source(glb, stream_accessor(glb, a/4, a%4), source_a);
+
+        for (int b = 0; b < streams; b++) {
+            uint64_t length_b, source_b[3];
+            const unsigned char *stream_b = get_stream(fgm, b/4, b%4, &length_b);
+
+            accessor_source(glb, stream_accessor(glb, b/4, b%4), source_b);
+
+            int same = content ? length_a == length_b && memcmp(stream_a, stream_b, (size_t)length_a) == 0
+                               : memcmp(source_a, source_b, sizeof(source_a)) == 0;
+
+            if (same != (stream_a == stream_b))
+                return fail("mesh %d stream %d and mesh %d stream %d %s", a/4, a%4, b/4, b%4,
+                            same ? "are written twice" : "are merged");
+
+            if (same && b < a)
+                first = 0;
+        }
+
+        if (first)
+            written += length_a;
+    }
+
+    /* nothing else in the buffer but the distinct streams and the padding before the sections */
+    uint64_t buffer = fgm->buffer_end - fgm->buffer;
+    if (written > buffer || buffer - written >= FGM_SECTION_ALIGN)
+        return fail("%lu bytes buffer for %lu bytes of streams", (unsigned long)buffer, (unsigned long)written);
+
+    return 1;
+}
+
+static int check_share(const Glb *glb, const Fgm *fgm)
+{
+    return check_shared(glb, fgm, 0);
+}
+
+static int check_share_content(const Glb *glb, const Fgm *fgm)
+{
+    return check_shared(glb, fgm, 1);
+}
+
+static int check_stream_convert(const Glb *glb, const Fgm *fgm)
+{
+    /* converting from a FILE gives the bytes of the in-memory conversion,
+     * interleaved streams included */
+
+    struct GLB_Options options = { 0, NULL };
+    FILE *in = tmpfile(), *out = tmpfile();
+    unsigned char *data = NULL;
+    int ok = 0;
+
+    if (in == NULL || out == NULL || fwrite(glb->data, 1, glb->length, in) != glb->length) {
+        fail("could not write a temporary file");
+        goto end;
+    }
+    rewind(in);
+
+    if (!FGM_ConvertStream(in, out, &options)) {
+        fail("stream conversion failed");
+        goto end;
+    }
+
+    long length = ftell(out);
+    rewind(out);
+
+    data = malloc(fgm->length + 1);
+    if (data == NULL || length < 0 || (size_t)length != fgm->length ||
+        fread(data, 1, fgm->length, out) != fgm->length || memcmp(data, fgm->data, fgm->length) != 0) {
+        fail("stream conversion differs from the in-memory one (%ld bytes instead of %lu)", length,
+             (unsigned long)fgm->length);
+        goto end;
+    }
+
+    ok = 1;
+
+end:
+    free(data);
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL)
+        fclose(out);
+    return ok;
+}
+
+static int check_stream_invalid(const Glb *glb, const Fgm *fgm)
+{
+    /* chunk lengths beyond the GLB length, or a JSON chunk over the cap,
+     * fail before anything is allocated for them, with and without
+     * options */
+
+    uint32_t json_length = read_u32(glb->data + 12);
+    const struct { size_t offset; uint32_t value; } patches[] = {
+        { 12, 0xfffffff0u },
+        { 12, (uint32_t)glb->length - 27 },
+        { 8, json_length + 27 },
+        { 20 + (size_t)json_length, (uint32_t)glb->length },
+    };
+    unsigned char *copy = malloc(glb->length);
+    int status = 1;
+
+    (void)fgm;
+
+    if (copy == NULL)
+        return fail("out of memory");
+
+    for (size_t p = 0; status && p < sizeof(patches)/sizeof(patches[0]); p++) {
+        for (int with_flags = 0; status && with_flags < 2; with_flags++) {
+            struct GLB_Options options = { with_flags ? GLB_FLAG_BVH : 0, NULL };
+            FILE *in = tmpfile(), *out = tmpfile();
+
+            memcpy(copy, glb->data, glb->length);
+            memcpy(copy + patches[p].offset, &patches[p].value, 4);
+
+            if (in == NULL || out == NULL || fwrite(copy, 1, glb->length, in) != glb->length)
+                status = fail("could not write a temporary file");
+            else {
+                rewind(in);
+                if (FGM_ConvertStream(in, out, &options))
+                    status = fail("converted with %u at byte %lu%s", patches[p].value,
+                                  (unsigned long)patches[p].offset, with_flags ? " and --bvh" : "");
+            }
+
+            if (in != NULL)
+                fclose(in);
+            if (out != NULL)
+                fclose(out);
+        }
+    }
+
+    free(copy);
+    return status;
+}
+
+static int check_skin(const Glb *glb, const Fgm *fgm)
+{
+    size_t length;
+    const unsigned char *skin = find_section(fgm, FGM_SECTION_SKIN, &length);
+    int meshes = fgm->num_meshes;
+
+    if (skin == NULL || length < 16 + 16 + 16*(size_t)meshes)
+        return fail("missing or short SKIN section");
+
+    if (read_u32(skin) != 1 || read_u32(skin + 4) != (uint32_t)meshes || read_u32(skin + 8) != 16 ||
+        read_u32(skin + 12) != 32)
+        return fail("header %u %u %u %u", read_u32(skin), read_u32(skin + 4), read_u32(skin + 8), read_u32(skin + 12));
+
+    /* joints are the two nodes after the mesh nodes, the first being the skeleton */
+    uint32_t joints = read_u32(skin + 20), matrices = read_u32(skin + 24);
+
+    if (read_u32(skin + 16) != 2 || read_i32(skin + 28) != meshes || joints > length - 8 || matrices > length - 128)
+        return fail("skin entry %u %u %u %d", read_u32(skin + 16), joints, matrices, read_i32(skin + 28));
+
+    for (int j = 0; j < 2; j++) {
+        if (read_i32(skin + joints + 4*j) != meshes + j)
+            return fail("joint %d is node %d", j, read_i32(skin + joints + 4*j));
+
+        for (int i = 0; i < 16; i++) {
+            float expected = i == 12 ? (float)-j : i % 5 == 0 ? 1.0f : 0.0f;
+
+            if (read_f32(skin + matrices + 64*j + 4*i) != expected)
+                return fail("inverse bind matrix %d [%d] is %g", j, i, read_f32(skin + matrices + 64*j + 4*i));
+        }
+    }
+
+    gJSON *gmeshes = gJSON_GetObjectItem(glb->json, "meshes");
+
+    for (int m = 0; m < meshes; m++) {
+        const unsigned char *entry = skin + 32 + 16*m;
+        gJSON *attributes = gJSON_GetObjectItem(gJSON_GetArrayItem(gJSON_GetObjectItem(
+                                gJSON_GetArrayItem(gmeshes, m), "primitives"), 0), "attributes");
+        int vertices = get_int(gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "accessors"),
+                                                  get_int(attributes, "POSITION", -1)), "count", 0);
+        uint64_t offset = read_u64(entry + 8);
+
+        /* only node 0 uses the skin, the other meshes still have their stream */
+        if (read_i32(entry) != (m == 0 ? 0 : -1) || read_u32(entry + 4) != (uint32_t)vertices ||
+            offset > length - 8*(uint64_t)vertices)
+            return fail("mesh %d entry %d %u %lu", m, read_i32(entry), read_u32(entry + 4), (unsigned long)offset);
+
+        for (int v = 0; v < vertices; v++) {
+            const unsigned char *packed = skin + offset + 8*(size_t)v;
+
+            if (packed[0] != v % 2 || packed[1] != (v + 1) % 2 || packed[2] != 0 || packed[3] != 0 ||
+                packed[4] + packed[5] != 255 || abs(packed[4] - 153) > 1 || packed[6] != 0 || packed[7] != 0)
+                return fail("mesh %d vertex %d packed as %u %u %u %u / %u %u %u %u", m, v, packed[0], packed[1],
+                            packed[2], packed[3], packed[4], packed[5], packed[6], packed[7]);
+        }
+    }
+
+    return 1;
+}
+
+static int check_track(const unsigned char *anim, size_t length, const unsigned char *track, int frames,
+                       int node, int path, int components, uint32_t flags, void (*expect)(float, float*))
+{
+    int stored = flags & 1 ? 1 : frames;
+    uint32_t keys = read_u32(track + 12);
+
+    if (read_i32(track) != node || (read_u32(track + 4) & 0xFFFF) != (uint32_t)path ||
+        read_u32(track + 4) >> 16 != (uint32_t)components || read_u32(track + 8) != flags ||
+        keys > length - 2*(size_t)components*stored)
+        return fail("track of node %d path %d is %d %u %u %u", node, path, read_i32(track),
+                    read_u32(track + 4) & 0xFFFF, read_u32(track + 4) >> 16, read_u32(track + 8));
+
+    for (int f = 0; f < frames; f++) {
+        const unsigned char *key = anim + keys + 2*(size_t)components*(f < stored ? f : 0);
+        float expected[4];
+
+        expect((float)f / 60.0f, expected);
+
+        for (int i = 0; i < components; i++) {
+            uint16_t k;
+            memcpy(&k, key + 2*i, 2);
+
+            float value = read_f32(track + 16 + 4*i) + read_f32(track + 32 + 4*i)*k;
+
+            if (fabsf(value - expected[i]) > 1e-3f)
+                return fail("node %d path %d frame %d [%d] is %g instead of %g", node, path, f, i, value,
+                            expected[i]);
+        }
+    }
+
+    return 1;
+}
+
+static void expect_translation(float t, float *out)
+{
+    /* (0, 0, 0), (1, 2, 3), (2, 0, -2) at 0, 0.5 and 1 */
+    float u = t < 0.5f ? t*2.0f : t*2.0f - 1.0f;
+    float a[3] = { 0, 0, 0 }, b[3] = { 1, 2, 3 }, c[3] = { 2, 0, -2 };
+
+    for (int i = 0; i < 3; i++)
+        out[i] = t < 0.5f ? a[i] + (b[i] - a[i])*u : b[i] + (c[i] - b[i])*u;
+}
+
+static void expect_scale(float t, float *out)
+{
+    (void)t;
+    out[0] = out[1] = out[2] = 2.0f;
+}
+
+static void expect_rotation(float t, float *out)
+{
+    /* quarter turn around Z in one second */
+    float half = t*0.78539816f;
+
+    out[0] = out[1] = 0.0f;
+    out[2] = sinf(half);
+    out[3] = cosf(half);
+}
+
+static int check_anim(const Glb *glb, const Fgm *fgm)
+{
+    size_t length;
+    const unsigned char *anim = find_section(fgm, FGM_SECTION_ANIM, &length);
+    int last_node = count_items(gJSON_GetObjectItem(glb->json, "nodes")) - 1;
+
+    if (anim == NULL || length < 32)
+        return fail("missing or short ANIM section");
+
+    if (read_u32(anim) != 1 || read_u32(anim + 4) != 60 || read_u32(anim + 8) != 16)
+        return fail("header %u %u %u", read_u32(anim), read_u32(anim + 4), read_u32(anim + 8));
+
+    /* 0 to 1 second at 60 frames per second */
+    int frames = (int)read_u32(anim + 16);
+    uint32_t tracks = read_u32(anim + 24);
+
+    if (frames != 61 || read_u32(anim + 20) != 3 || read_f32(anim + 28) != 1.0f || tracks > length - 3*48)
+        return fail("animation entry %d %u %u %g", frames, read_u32(anim + 20), tracks, read_f32(anim + 28));
+
+    return check_track(anim, length, anim + tracks, frames, 0, 0, 3, 0, expect_translation) &&
+           check_track(anim, length, anim + tracks + 48, frames, 0, 2, 3, 1, expect_scale) &&
+           check_track(anim, length, anim + tracks + 96, frames, last_node, 1, 4, 0, expect_rotation);
+}
+
+static int check_anim_invalid(const Glb *glb, const Fgm *fgm)
+{
+    /* a last key time that is NaN, infinite or too far away fails the
+     * conversion rather than wrapping the frame count */
+
+    static const uint32_t times[3] = { 0x7fc00000, 0x7f800000, 0x4e6e6b28 }; /* NaN, infinity, 1e9 */
+    gJSON *sampler = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(
+                         gJSON_GetObjectItem(glb->json, "animations"), 0), "samplers"), 0);
+    uint64_t source[3];
+    int status = 1;
+
+    (void)fgm;
+
+    accessor_source(glb, get_int(sampler, "input", -1), source);
+    size_t last = (size_t)(glb->bin - glb->data) + (size_t)source[0] + 4*((size_t)source[2] - 1);
+
+    for (int i = 0; status && i < 3; i++) {
+        Glb patched;
+        Fgm converted;
+
+        if (convert_patched(glb, last, &times[i], 4, GLB_FLAG_ANIM, &patched, &converted))
+            status = fail("converted with a last key time of %g", read_f32(patched.data + last));
+        free(converted.data);
+        free(patched.data);
+    }
+
+    return status;
+}
+
+static uint32_t *read_indices(const Glb *glb, gJSON *primitive, int *count)
+{
+    size_t element_size;
+    unsigned char *data = read_accessor(glb, get_int(primitive, "indices", -1), &element_size, count);
+    uint32_t *indices = data != NULL ? malloc(sizeof(uint32_t)*(*count)) : NULL;
+
+    for (int i = 0; indices != NULL && i < *count; i++) {
+        if (element_size == 2) {
+            uint16_t index;
+            memcpy(&index, data + 2*i, 2);
+            indices[i] = index;
+        } else {
+            indices[i] = element_size == 4 ? read_u32(data + 4*i) : data[i];
+        }
+    }
+
+    free(data);
+    return indices;
+}
+
+static int compare_triangles(const void *a, const void *b)
+{
+    return memcmp(a, b, 12);
+}
+
+static int check_bvh_node(const unsigned char *nodes, uint32_t node_count, uint32_t index, const float *parent,
+                          const uint32_t *triangles, uint32_t triangle_count, const float *positions,
+                          unsigned char *covered, int depth)
+{
+    /* bounds inside the parent ones, leaves holding their triangles */
+
+    const unsigned char *node = nodes + 32*(size_t)index;
+    float bounds[6];
+    uint32_t first = read_u32(node + 12), count = read_u32(node + 28);
+
+    for (int i = 0; i < 3; i++) {
+        bounds[i] = read_f32(node + 4*i);
+        bounds[3 + i] = read_f32(node + 16 + 4*i);
+
+        if (parent != NULL && (bounds[i] < parent[i] || bounds[3 + i] > parent[3 + i]))
+            return fail("node %u is not inside its parent", index);
+    }
+
+    if (depth > 64)
+        return fail("node %u is too deep", index);
+
+    if (count == 0) {
+        if (index + 1 >= node_count || first <= index + 1 || first >= node_count)
+            return fail("interior node %u has children %u and %u", index, index + 1, first);
+
+        return check_bvh_node(nodes, node_count, index + 1, bounds, triangles, triangle_count, positions,
+                              covered, depth + 1) &&
+               check_bvh_node(nodes, node_count, first, bounds, triangles, triangle_count, positions,
+                              covered, depth + 1);
+    }
+
+    if (first > triangle_count || count > triangle_count - first)
+        return fail("leaf %u holds triangles %u to %u of %u", index, first, first + count, triangle_count);
+
+    for (uint32_t t = first; t < first + count; t++) {
+        if (covered[t]++)
+            return fail("triangle %u is in two leaves", t);
+
+        for (int k = 0; k < 3; k++) {
+            const float *p = positions + 3*(size_t)triangles[3*t + k];
+
+            for (int i = 0; i < 3; i++) {
+                if (p[i] < bounds[i] || p[i] > bounds[3 + i])
+                    return fail("triangle %u is outside of leaf %u", t, index);
+            }
+        }
+    }
+
+    return 1;
+}
+
+static int check_bvh(const Glb *glb, const Fgm *fgm)
+{
+    /* each triangle of the GLB once in the leaves of a tree whose bounds contain them */
+
+    size_t length;
+    const unsigned char *bvh = find_section(fgm, FGM_SECTION_BVH, &length);
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+
+    if (bvh == NULL || length < 16 + 32*(size_t)fgm->num_meshes)
+        return fail("missing or short BVH section");
+
+    if (read_u32(bvh) != (uint32_t)fgm->num_meshes || read_u32(bvh + 4) != 32 || read_u32(bvh + 8) != 16)
+        return fail("header %u %u %u", read_u32(bvh), read_u32(bvh + 4), read_u32(bvh + 8));
+
+    for (int m = 0; m < fgm->num_meshes; m++) {
+        gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, m), "primitives"), 0);
+        const unsigned char *entry = bvh + 16 + 32*m;
+        uint32_t node_count = read_u32(entry), triangle_count = read_u32(entry + 4);
+        uint64_t nodes = read_u64(entry + 8), triangles = read_u64(entry + 16);
+        size_t element_size;
+        int index_count, vertex_count;
+
+        uint32_t *indices = read_indices(glb, primitive, &index_count);
+        float *positions = (float*)read_accessor(glb, get_int(gJSON_GetObjectItem(primitive, "attributes"),
+                                                 "POSITION", -1), &element_size, &vertex_count);
+        uint32_t *stored = malloc(12*(size_t)triangle_count + 1);
+        unsigned char *covered = calloc((size_t)triangle_count + 1, 1);
+        int status = 0;
+
+        if (indices == NULL || positions == NULL || stored == NULL || covered == NULL) {
+            fail("mesh %d could not be read", m);
+        } else if (triangle_count != (uint32_t)index_count/3 || node_count == 0 ||
+                   nodes > length - 32*(uint64_t)node_count || triangles > length - 12*(uint64_t)triangle_count) {
+            fail("mesh %d entry %u %u %lu %lu", m, node_count, triangle_count, (unsigned long)nodes,
+                 (unsigned long)triangles);
+        } else {
+            memcpy(stored, bvh + triangles, 12*(size_t)triangle_count);
+            status = 1;
+
+            for (uint32_t i = 0; status && i < 3*triangle_count; i++) {
+                if (stored[i] >= (uint32_t)vertex_count)
+                    status = fail("mesh %d triangle %u uses vertex %u", m, i/3, stored[i]);
+            }
+
+            status = status && check_bvh_node(bvh + nodes, node_count, 0, NULL, stored, triangle_count,
+                                              positions, covered, 0);
+
+            for (uint32_t t = 0; status && t < triangle_count; t++) {
+                if (!covered[t])
+                    status = fail("mesh %d triangle %u is in no leaf", m, t);
+            }
+
+            /* the same triangles as the GLB, in leaf order */
+            qsort(stored, triangle_count, 12, compare_triangles);
+            qsort(indices, triangle_count, 12, compare_triangles);
+
+            if (status && memcmp(stored, indices, 12*(size_t)triangle_count) != 0)
+                status = fail("mesh %d triangles differ from the GLB ones", m);
+        }
+
+        free(indices);
+        free(positions);
+        free(stored);
+        free(covered);
+
+        if (!status)
+            return 0;
+    }
+
+    return 1;
+}
+
+static int check_bvh_invalid(const Glb *glb, const Fgm *fgm)
+{
+    /* a NaN or infinite position fails the conversion, positions at the
+     * ends of the float range still give a valid tree */
+
+    static const float invalid[2] = { NAN, INFINITY };
+    static const float extremes[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(
+                           gJSON_GetObjectItem(glb->json, "meshes"), 0), "primitives"), 0);
+    uint64_t source[3];
+    int status = 1;
+    Glb patched;
+    Fgm converted;
+
+    (void)fgm;
+
+    accessor_source(glb, get_int(gJSON_GetObjectItem(primitive, "attributes"), "POSITION", -1), source);
+    size_t position = (size_t)(glb->bin - glb->data) + (size_t)source[0];
+
+    for (int i = 0; status && i < 2; i++) {
+        if (convert_patched(glb, position + 4, &invalid[i], 4, GLB_FLAG_BVH, &patched, &converted))
+            status = fail("converted with a position of %g", invalid[i]);
+        free(converted.data);
+        free(patched.data);
+    }
+
+    if (!status)
+        return 0;
+
+    /* the stride of the generated positions is 12 bytes */
+    if (!convert_patched(glb, position, extremes, sizeof(extremes), GLB_FLAG_BVH, &patched, &converted))
+        status = fail("positions at the ends of the float range did not convert");
+
+    free(converted.data);
+
+    if (status && convert(&patched, GLB_FLAG_BVH, &converted) && !check_bvh(&patched, &converted))
+        status = 0;
+
+    free(converted.data);
+    free(patched.data);
+
+    return status;
+}
+
+static float *read_floats(const Glb *glb, gJSON *attributes, const char *name, int *count)
+{
+    size_t element_size;
+    return (float*)read_accessor(glb, get_int(attributes, name, -1), &element_size, count);
+}
+
+static int decode_written(const unsigned char *data, size_t length, const struct GLB_Options *options,
+                          struct GLB_Meshes *meshes, unsigned char **fgm, size_t *fgm_length)
+{
+    /* decodes like the converter does when it caches, keeping the meshes
+     * for their hashes */
+
+    if (!GLB_Decode(meshes, data, length, options))
+        return 0;
+
+    *fgm_length = FGM_Size(meshes);
+    if ((*fgm = malloc(*fgm_length)) == NULL) {
+        GLB_FreeMeshes(meshes);
+        return 0;
+    }
+
+    FGM_Write(meshes, *fgm);
+    return 1;
+}
+
+static int check_reuse(const Glb *glb, const Fgm *fgm)
+{
+    /* with the output of the GLB as previous output, a GLB whose last mesh
+     * moved gives the bytes of a fresh conversion, and the BVH and tangents
+     * of every mesh that hashes like before are copied */
+
+    uint32_t flags = GLB_FLAG_BVH | GLB_FLAG_TANGENTS;
+    struct GLB_Options options = { flags, NULL, 0, 0, 1, NULL };
+    struct GLB_Meshes first, second;
+    struct GLB_Previous previous;
+    struct ConvertStats stats;
+    unsigned char *old_fgm = NULL, *new_fgm = NULL;
+    size_t old_length, new_length;
+    uint64_t source[3];
+    float x;
+    int unchanged = 0, status = 0;
+    Glb patched;
+    Fgm fresh;
+
+    (void)fgm;
+    memset(&fresh, 0, sizeof(fresh));
+    patched.data = NULL;
+
+    if (!decode_written(glb->data, glb->length, &options, &first, &old_fgm, &old_length))
+        return fail("conversion failed");
+
+    if (first.hashes == NULL) {
+        fail("no mesh hashes");
+        goto end_first;
+    }
+
+    /* moves the first vertex of the last mesh */
+    accessor_source(glb, stream_accessor(glb, first.num_meshes - 1, 0), source);
+    size_t position = (size_t)(glb->bin - glb->data) + (size_t)source[0];
+    memcpy(&x, glb->data + position, 4);
+    x += 1.0f;
+
+    if (!convert_patched(glb, position, &x, 4, flags, &patched, &fresh)) {
+        fail("the patched GLB did not convert");
+        goto end_first;
+    }
+
+    previous.num_meshes = first.num_meshes;
+    previous.hashes = first.hashes;
+    previous.fgm = old_fgm;
+    previous.length = old_length;
+
+    FGM_StatsInit(&stats);
+    options.stats = &stats;
+    options.previous = &previous;
+
+    if (!decode_written(patched.data, patched.length, &options, &second, &new_fgm, &new_length)) {
+        fail("conversion with a previous output failed");
+        goto end_first;
+    }
+
+    for (int m = 0; m < second.num_meshes; m++) {
+        for (int p = 0; p < first.num_meshes; p++) {
+            if (second.hashes[m] == first.hashes[p]) {
+                unchanged++;
+                break;
+            }
+        }
+    }
+
+    if (unchanged == second.num_meshes)
+        fail("the moved mesh hashes like before");
+    else if (new_length != fresh.length || memcmp(new_fgm, fresh.data, new_length) != 0)
+        fail("the output differs from a fresh conversion (%lu bytes instead of %lu)", (unsigned long)new_length,
+             (unsigned long)fresh.length);
+    else if (stats.sections_reused != 2*(uint64_t)unchanged)
+        fail("%llu section entries reused for %d unchanged meshes", (unsigned long long)stats.sections_reused,
+             unchanged);
+    else
+        status = 1;
+
+    GLB_FreeMeshes(&second);
+
+end_first:
+    GLB_FreeMeshes(&first);
+    free(old_fgm);
+    free(new_fgm);
+    free(fresh.data);
+    free(patched.data);
+    return status;
+}
+
+static int check_tangents(const Glb *glb, const Fgm *fgm)
+{
+    /* generated tangents are unit length, orthogonal to the normal, with a
+     * handedness of 1 or -1. On glbgen -T ribbons they also point along U
+     * with the handedness of their side of the mirrored seam */
+
+    size_t length;
+    const unsigned char *tang = find_section(fgm, FGM_SECTION_TANGENTS, &length);
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+
+    if (tang == NULL || length < 16 + 16*(size_t)fgm->num_meshes)
+        return fail("missing or short TANG section");
+
+    if (read_u32(tang) != (uint32_t)fgm->num_meshes || read_u32(tang + 4) != 16)
+        return fail("header %u %u", read_u32(tang), read_u32(tang + 4));
+
+    for (int m = 0; m < fgm->num_meshes; m++) {
+        gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, m), "primitives"), 0);
+        gJSON *attributes = gJSON_GetObjectItem(primitive, "attributes");
+        int ribbon = gJSON_GetObjectItem(gJSON_GetObjectItem(primitive, "extras"), "ribbon") != NULL;
+        const unsigned char *entry = tang + 16 + 16*m;
+        uint64_t offset = read_u64(entry);
+        int count;
+
+        float *normals = read_floats(glb, attributes, "NORMAL", &count);
+        int status = normals != NULL;
+
+        if (status && (read_u32(entry + 8) != (uint32_t)count || read_u32(entry + 12) != FGM_TANGENT_GENERATED ||
+                       offset > length - 16*(uint64_t)count))
+            status = fail("mesh %d entry %lu %u %u", m, (unsigned long)offset, read_u32(entry + 8),
+                          read_u32(entry + 12));
+
+        for (int v = 0; status && v < count; v++) {
+            const unsigned char *tangent = tang + offset + 16*(size_t)v;
+            float t[4], n[3], dot = 0.0f, n_length = 0.0f, t_length = 0.0f;
+
+            for (int i = 0; i < 4; i++)
+                t[i] = read_f32(tangent + 4*i);
+            memcpy(n, normals + 3*v, sizeof(n));
+
+            for (int i = 0; i < 3; i++) {
+                dot += t[i]*n[i];
+                n_length += n[i]*n[i];
+                t_length += t[i]*t[i];
+            }
+
+            if (fabsf(t_length - 1.0f) > 1e-3f || fabsf(dot) > 1e-3f*sqrtf(n_length) ||
+                (t[3] != 1.0f && t[3] != -1.0f))
+                status = fail("mesh %d vertex %d tangent (%g %g %g %g)", m, v, t[0], t[1], t[2], t[3]);
+
+            /* the vertices of the seam column belong to both sides */
+            int columns = (count + 1)/2, side = v/2 < columns/2 ? -1 : (v/2 > columns/2 ? 1 : 0);
+
+            if (status && ribbon && side != 0 &&
+                (fabsf(t[0] - side) > 1e-3f || fabsf(t[1]) > 1e-3f || fabsf(t[2]) > 1e-3f || t[3] != side))
+                status = fail("mesh %d vertex %d tangent (%g %g %g %g) instead of (%d 0 0 %d)", m, v, t[0], t[1],
+                              t[2], t[3], side, side);
+        }
+
+        free(normals);
+
+        if (!status)
+            return 0;
+    }
+
+    return 1;
+}
+
+static int check_tangents_invalid(const Glb *glb, const Fgm *fgm)
+{
+    /* an index accessor of unknown component type fails the conversion
+     * rather than the mesh being read as a plain triangle list */
+
+    uint32_t json_length = read_u32(glb->data + 12);
+    unsigned char *copy = malloc(glb->length);
+    unsigned char *fgm_data = NULL;
+    size_t fgm_length;
+    int status = 0;
+
+    (void)fgm;
+
+    if (copy == NULL)
+        return fail("out of memory");
+
+    memcpy(copy, glb->data, glb->length);
+
+    /* the first index accessor, keeping the JSON length */
+    for (size_t i = 20; i + 21 < 20 + (size_t)json_length; i++) {
+        if (memcmp(copy + i, "\"componentType\":5123,", 21) == 0 ||
+            memcmp(copy + i, "\"componentType\":5125,", 21) == 0) {
+            copy[i + 19] = '9';
+            status = 1;
+            break;
+        }
+    }
+
+    struct GLB_Options options = { GLB_FLAG_TANGENTS, NULL };
+
+    if (!status)
+        fail("no index accessor");
+    else if (FGM_Convert(copy, glb->length, &options, &fgm_data, &fgm_length))
+        status = fail("converted with an invalid index accessor");
+
+    free(fgm_data);
+    free(copy);
+
+    return status;
+}
+
+static void glbgen_matrix(int node, int meshes, float *m)
+{
+    /* local matrix of a glbgen node, see the top of glbgen.c. The mesh nodes
+     * are roots and the joints have no transform */
+
+    memset(m, 0, sizeof(float)*16);
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+
+    if (node >= meshes)
+        return;
+
+    switch (node % 4) {
+        case 1:
+            m[12] = 1.0f;
+            m[13] = 2.0f;
+            m[14] = 3.0f;
+            break;
+        case 2:
+            /* 30 degrees around Z, (1, 0, 0) becomes (0.866, 0.5, 0) */
+            m[0] = m[5] = 0.86602540f;
+            m[1] = 0.5f;
+            m[4] = -0.5f;
+            break;
+        case 3:
+            m[0] = -1.0f;
+            break;
+    }
+}
+
+static int near(const float *a, const float *b, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (fabsf(a[i] - b[i]) > 1e-4f*(1.0f + fabsf(b[i])))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int check_instance(const Glb *glb, const Fgm *fgm, gJSON *primitive, int batch, const float *world,
+                          uint64_t *vertex_cursor, uint64_t *index_cursor, int wide)
+{
+    /* the primitive at the cursors of the batch, placed by world unless it is NULL */
+
+    gJSON *attributes = gJSON_GetObjectItem(primitive, "attributes");
+    uint64_t lengths[4];
+    const unsigned char *streams[4];
+    int count, texcoord_count, index_count;
+    int status = 1;
+
+    float *positions = read_floats(glb, attributes, "POSITION", &count);
+    float *normals = read_floats(glb, attributes, "NORMAL", &count);
+    float *texcoords = read_floats(glb, attributes, "TEXCOORD_0", &texcoord_count);
+    uint32_t *indices = read_indices(glb, primitive, &index_count);
+
+    for (int s = 0; s < 4; s++)
+        streams[s] = get_stream(fgm, batch, s, &lengths[s]);
+
+    size_t index_size = wide ? 4 : 2;
+    uint64_t first = *vertex_cursor;
+
+    if (positions == NULL || normals == NULL || texcoords == NULL || indices == NULL)
+        status = fail("could not read the GLB");
+    else if (streams[0] == NULL || streams[3] == NULL || lengths[0] < 12*(first + count) ||
+             lengths[1] < 12*(first + count) || lengths[2] < 8*(first + count) ||
+             lengths[3] < index_size*(*index_cursor + index_count))
+        status = fail("batch %d is too short", batch);
+
+    float m[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    if (world != NULL)
+        memcpy(m, world, sizeof(m));
+
+    for (int v = 0; status && v < count; v++) {
+        const float *p = positions + 3*v, *n = normals + 3*v;
+        float position[3], normal[3], stored[8], length = 0.0f;
+
+        /* the glbgen matrices are orthogonal, normals transform like directions */
+        for (int i = 0; i < 3; i++) {
+            position[i] = m[i]*p[0] + m[4 + i]*p[1] + m[8 + i]*p[2] + m[12 + i];
+            normal[i] = m[i]*n[0] + m[4 + i]*n[1] + m[8 + i]*n[2];
+            length += normal[i]*normal[i];
+        }
+
+        for (int i = 0; world != NULL && i < 3; i++)
+            normal[i] /= sqrtf(length);
+
+        for (int i = 0; i < 3; i++) {
+            stored[i] = read_f32(streams[0] + 12*(first + v) + 4*i);
+            stored[3 + i] = read_f32(streams[1] + 12*(first + v) + 4*i);
+        }
+        stored[6] = read_f32(streams[2] + 8*(first + v));
+        stored[7] = read_f32(streams[2] + 8*(first + v) + 4);
+
+        if (!near(stored, position, 3) || !near(stored + 3, normal, 3) || !near(stored + 6, texcoords + 2*v, 2))
+            status = fail("batch %d vertex %lu is (%g %g %g) (%g %g %g) instead of (%g %g %g) (%g %g %g)", batch,
+                          (unsigned long)(first + v), stored[0], stored[1], stored[2], stored[3], stored[4],
+                          stored[5], position[0], position[1], position[2], normal[0], normal[1], normal[2]);
+    }
+
+    /* rebased, and a mirroring matrix flips the winding */
+    float det = m[0]*(m[5]*m[10] - m[6]*m[9]) - m[4]*(m[1]*m[10] - m[2]*m[9]) + m[8]*(m[1]*m[6] - m[2]*m[5]);
+
+    for (int i = 0; status && i < index_count; i++) {
+        int source = det < 0.0f && i % 3 != 0 ? i - i % 3 + 3 - i % 3 : i;
+        uint64_t at = (*index_cursor + i)*index_size;
+        uint32_t index = wide ? read_u32(streams[3] + at) : (uint32_t)(streams[3][at] | streams[3][at + 1] << 8);
+
+        if (index != indices[source] + first)
+            status = fail("batch %d index %lu is %u instead of %lu", batch, (unsigned long)(*index_cursor + i),
+                          index, (unsigned long)(indices[source] + first));
+    }
+
+    *vertex_cursor += count;
+    *index_cursor += index_count;
+
+    free(positions);
+    free(normals);
+    free(texcoords);
+    free(indices);
+
+    return status;
+}
+
+static int check_flatten(const Glb *glb, const Fgm *fgm)
+{
+    /* glbgen nodes in scene order : static primitives merged by material in
+     * world space, those of animated or skinned nodes in batches of their own */
+
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+    gJSON *nodes = gJSON_GetObjectItem(glb->json, "nodes");
+    int mesh_count = count_items(meshes), node_count = count_items(nodes);
+    int batch_limit = 0, batch_count = 0, wide = 0, status = 1;
+
+    for (gJSON *mesh = gJSON_GetArrayItem(meshes, 0); mesh != NULL; mesh = mesh->next) {
+        for (gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(mesh, "primitives"), 0); primitive != NULL;
+             primitive = primitive->next) {
+            gJSON *accessor = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "accessors"),
+                                                 get_int(primitive, "indices", -1));
+            wide |= get_int(accessor, "componentType", 0) == 5125;
+            batch_limit++;
+        }
+    }
+
+    char *dynamic = calloc(node_count + 1, 1);
+    int *parent = malloc(sizeof(int)*(node_count + 1));
+    int *batch_node = malloc(sizeof(int)*(batch_limit + 1));
+    int *batch_material = malloc(sizeof(int)*(batch_limit + 1));
+    uint64_t *vertex_cursor = calloc(batch_limit + 1, sizeof(uint64_t));
+    uint64_t *index_cursor = calloc(batch_limit + 1, sizeof(uint64_t));
+
+    if (dynamic == NULL || parent == NULL || batch_node == NULL || batch_material == NULL || vertex_cursor == NULL ||
+        index_cursor == NULL) {
+        status = fail("out of memory");
+        goto end;
+    }
+
+    /* animated and skinned nodes, then their children which come after them in glbgen files */
+    for (gJSON *animation = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "animations"), 0); animation != NULL;
+         animation = animation->next) {
+        for (gJSON *channel = gJSON_GetArrayItem(gJSON_GetObjectItem(animation, "channels"), 0); channel != NULL;
+             channel = channel->next)
+            dynamic[get_int(gJSON_GetObjectItem(channel, "target"), "node", node_count)] = 1;
+    }
+
+    for (int n = 0; n < node_count; n++)
+        parent[n] = -1;
+
+    for (int n = 0; n < node_count; n++) {
+        gJSON *node = gJSON_GetArrayItem(nodes, n);
+
+        dynamic[n] |= gJSON_GetObjectItem(node, "skin") != NULL;
+
+        for (gJSON *child = gJSON_GetArrayItem(gJSON_GetObjectItem(node, "children"), 0); child != NULL;
+             child = child->next) {
+            parent[child->valueint] = n;
+            dynamic[child->valueint] |= dynamic[n];
+        }
+    }
+
+    for (int n = 0; status && n < mesh_count; n++) {
+        gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, n), "primitives"), 0);
+        float world[16];
+
+        glbgen_matrix(n, mesh_count, world);
+
+        for (; status && primitive != NULL; primitive = primitive->next) {
+            int material = get_int(primitive, "material", -1);
+            int batch = batch_count;
+
+            for (int b = 0; !dynamic[n] && b < batch_count; b++) {
+                if (batch_node[b] < 0 && batch_material[b] == material)
+                    batch = b;
+            }
+
+            if (batch == batch_count) {
+                batch_node[batch] = dynamic[n] ? n : -1;
+                batch_material[batch] = material;
+                batch_count++;
+            }
+
+            if (batch >= fgm->num_meshes)
+                status = fail("%d batches instead of more than %d", fgm->num_meshes, batch);
+            else
+                status = check_instance(glb, fgm, primitive, batch, dynamic[n] ? NULL : world,
+                                        &vertex_cursor[batch], &index_cursor[batch], wide);
+        }
+    }
+
+    if (status && batch_count != fgm->num_meshes)
+        status = fail("%d batches instead of %d", fgm->num_meshes, batch_count);
+
+    for (int b = 0; status && b < batch_count; b++) {
+        const unsigned char *sizes = fgm->data + 2 + 32*(size_t)b;
+
+        if (read_u64(sizes) != 12*vertex_cursor[b] || read_u64(sizes + 16) != 8*vertex_cursor[b] ||
+            read_u64(sizes + 24) != (wide ? 4 : 2)*index_cursor[b])
+            status = fail("batch %d holds more than its primitives", b);
+    }
+
+    /* the node table */
+    size_t length;
+    const unsigned char *table = find_section(fgm, FGM_SECTION_NODES, &length);
+
+    if (status && (table == NULL || length < 16 + 80*(size_t)node_count + 4*(size_t)batch_count))
+        status = fail("missing or short NODE section");
+
+    if (status && (read_u32(table) != (uint32_t)node_count || read_u32(table + 4) != (uint32_t)batch_count ||
+                   read_u32(table + 8) != 16 || read_u32(table + 12) != 16 + 80*(uint32_t)node_count))
+        status = fail("NODE header %u %u %u %u", read_u32(table), read_u32(table + 4), read_u32(table + 8),
+                      read_u32(table + 12));
+
+    for (int b = 0; status && b < batch_count; b++) {
+        if (read_i32(table + 16 + 80*(size_t)node_count + 4*b) != batch_node[b])
+            status = fail("batch %d belongs to node %d instead of %d", b,
+                          read_i32(table + 16 + 80*(size_t)node_count + 4*b), batch_node[b]);
+    }
+
+    for (int n = 0; status && n < node_count; n++) {
+        const unsigned char *entry = table + 16 + 80*(size_t)n;
+        uint32_t first = 0, count = 0;
+        float local[16], stored[16];
+
+        for (int b = batch_count - 1; b >= 0; b--) {
+            if (batch_node[b] == n) {
+                first = (uint32_t)b;
+                count++;
+            }
+        }
+
+        glbgen_matrix(n, mesh_count, local);
+        for (int i = 0; i < 16; i++)
+            stored[i] = read_f32(entry + 16 + 4*i);
+
+        if (read_i32(entry) != parent[n] || read_u32(entry + 4) != first || read_u32(entry + 8) != count ||
+            read_u32(entry + 12) != (dynamic[n] ? FGM_NODE_DYNAMIC : 0) || !near(stored, local, 16))
+            status = fail("node %d entry %d %u %u %u", n, read_i32(entry), read_u32(entry + 4), read_u32(entry + 8),
+                          read_u32(entry + 12));
+    }
+
+end:
+    free(dynamic);
+    free(parent);
+    free(batch_node);
+    free(batch_material);
+    free(vertex_cursor);
+    free(index_cursor);
+
+    return status;
+}
+
+static int check_textures(const Glb *glb, const Fgm *fgm)
+{
+    /* the glbgen images, copied as they are on 16 byte boundaries of the file */
+
+    static const struct
+    {
+        uint32_t width, height, format;
+        const char *mime;
+    } images[4] = {
+        { 4, 2, FGM_TEXTURE_PNG, "image/png" },
+        { 3, 5, FGM_TEXTURE_JPEG, "image/jpeg" },
+        { 0, 0, FGM_TEXTURE_OTHER, "image/ktx2" },
+        { 0, 0, FGM_TEXTURE_EXTERNAL, "" },
+    };
+
+    size_t length;
+    const unsigned char *tex = find_section(fgm, FGM_SECTION_TEXTURES, &length);
+    gJSON *gimages = gJSON_GetObjectItem(glb->json, "images");
+
+    if (tex == NULL || length < 16 + 48*4)
+        return fail("missing or short TEX section");
+
+    if (read_u32(tex) != 4 || read_u32(tex + 4) != 16 || read_u32(tex + 8) != FGM_TEXTURE_ALIGN)
+        return fail("header %u %u %u", read_u32(tex), read_u32(tex + 4), read_u32(tex + 8));
+
+    for (int i = 0; i < 4; i++) {
+        const unsigned char *entry = tex + 16 + 48*i;
+        gJSON *view = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "bufferViews"),
+                                         get_int(gJSON_GetArrayItem(gimages, i), "bufferView", -1));
+        uint64_t offset = read_u64(entry), size = read_u64(entry + 8);
+        uint64_t expected = view != NULL ? (uint64_t)get_int(view, "byteLength", 0) : 0;
+        char mime[FGM_TEXTURE_MIME + 1] = { 0 };
+
+        memcpy(mime, entry + 32, FGM_TEXTURE_MIME);
+
+        if (size != expected || read_u32(entry + 16) != images[i].width || read_u32(entry + 20) != images[i].height ||
+            read_u32(entry + 24) != images[i].format || strcmp(mime, images[i].mime) != 0)
+            return fail("image %d entry %lu %u %u %u %s", i, (unsigned long)size, read_u32(entry + 16),
+                        read_u32(entry + 20), read_u32(entry + 24), mime);
+
+        if (view == NULL)
+            continue;
+
+        if (offset > length - size || (size_t)(tex + offset - fgm->data) % 16 != 0)
+            return fail("image %d at %lu", i, (unsigned long)offset);
+
+        if (memcmp(tex + offset, glb->bin + get_int(view, "byteOffset", 0), (size_t)size) != 0)
+            return fail("image %d differs from its bufferView", i);
+    }
+
+    return 1;
+}
+
+static void glbgen_morph(int v, float *position, float *normal)
+{
+    /* the deltas of glbgen -M for vertex v */
+
+    static const float moved[2][3] = { { 0.5f, -0.25f, 1.0f }, { -1.0f, 0.0f, 0.125f } };
+
+    for (int j = 0; j < 3; j++) {
+        position[j] = v == 1 ? moved[0][j] : (v == 3 ? moved[1][j] : 0.0f);
+        normal[j] = j == 2 && v % 4 == 0 ? 0.5f : 0.0f;
+    }
+}
+
+static int check_morph(const Glb *glb, const Fgm *fgm)
+{
+    size_t length;
+    const unsigned char *morph = find_section(fgm, FGM_SECTION_MORPH, &length);
+    gJSON *meshes = gJSON_GetObjectItem(glb->json, "meshes");
+
+    if (morph == NULL || length < 16)
+        return fail("no %s section", FGM_SECTION_MORPH);
+
+    uint32_t mesh_count = read_u32(morph), target_count = read_u32(morph + 4);
+    uint32_t meshes_offset = read_u32(morph + 8), targets_offset = read_u32(morph + 12);
+
+    if ((int)mesh_count != fgm->num_meshes || target_count != mesh_count)
+        return fail("%u meshes and %u targets", mesh_count, target_count);
+
+    if (meshes_offset + 16*(size_t)mesh_count > length || targets_offset + 48*(size_t)target_count > length)
+        return fail("tables past the section");
+
+    for (uint32_t m = 0; m < mesh_count; m++) {
+        const unsigned char *entry = morph + meshes_offset + 16*(size_t)m;
+        gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(meshes, (int)m), "primitives"), 0);
+        gJSON *position = gJSON_GetArrayItem(gJSON_GetObjectItem(glb->json, "accessors"),
+                                             get_int(gJSON_GetObjectItem(primitive, "attributes"), "POSITION", -1));
+        uint32_t first = read_u32(entry), vertex_count = read_u32(entry + 8);
+
+        if (first != m || read_u32(entry + 4) != 1 || (int)vertex_count != get_int(position, "count", -1))
+            return fail("mesh %u : first target %u, %u targets, %u vertices", m, first, read_u32(entry + 4),
+                        vertex_count);
+
+        const unsigned char *target = morph + targets_offset + 48*(size_t)first;
+        uint32_t moved = read_u32(target), flags = read_u32(target + 4);
+        uint64_t indices = read_u64(target + 8), deltas = read_u64(target + 16);
+        float scale[4] = { read_f32(target + 24), read_f32(target + 28), read_f32(target + 32), read_f32(target + 36) };
+        float expected_scale[4] = { 1.0f/32767.0f, 0.25f/32767.0f, 1.0f/32767.0f, 0.5f/32767.0f };
+        float weight = read_f32(target + 40);
+
+        if (flags != (FGM_MORPH_POSITION | FGM_MORPH_NORMAL | FGM_MORPH_INDEX16) || weight != 0.5f)
+            return fail("mesh %u : flags %u, weight %g", m, flags, weight);
+
+        for (int j = 0; j < 4; j++) {
+            if (fabsf(scale[j] - expected_scale[j]) > 1e-9f)
+                return fail("mesh %u : scale %d is %g instead of %g", m, j, scale[j], expected_scale[j]);
+        }
+
+        if (indices % FGM_SECTION_ALIGN != 0 || deltas % FGM_SECTION_ALIGN != 0 ||
+            indices + 2*(uint64_t)moved > length || deltas + 12*(uint64_t)moved > length)
+            return fail("mesh %u : indices at %lu, deltas at %lu", m, (unsigned long)indices,
+                        (unsigned long)deltas);
+
+        /* every vertex with a delta, ascending, decoding to the glbgen values */
+        uint32_t i = 0;
+
+        for (uint32_t v = 0; v < vertex_count; v++) {
+            float expected[6], decoded[6];
+
+            glbgen_morph((int)v, expected, expected + 3);
+            if (expected[0] == 0.0f && expected[1] == 0.0f && expected[2] == 0.0f && expected[5] == 0.0f)
+                continue;
+
+            if (i >= moved || (morph[indices + 2*i] | morph[indices + 2*i + 1] << 8) != (int)v)
+                return fail("mesh %u : vertex %u is not moved target entry %u", m, v, i);
+
+            for (int j = 0; j < 6; j++) {
+                int16_t key = (int16_t)(morph[deltas + 12*i + 2*j] | morph[deltas + 12*i + 2*j + 1] << 8);
+                decoded[j] = key*scale[j < 3 ? j : 3];
+
+                if (fabsf(decoded[j] - expected[j]) > scale[j < 3 ? j : 3])
+                    return fail("mesh %u vertex %u : delta %d is %g instead of %g", m, v, j, decoded[j],
+                                expected[j]);
+            }
+
+            i++;
+        }
+
+        if (i != moved)
+            return fail("mesh %u : %u moved vertices instead of %u", m, moved, i);
+    }
+
+    return 1;
+}
+
+static int check_morph_invalid(const Glb *glb, const Fgm *fgm)
+{
+    /* a delta accessor not matching the vertex count fails the conversion
+     * rather than the target losing its positions */
+
+    uint32_t json_length = read_u32(glb->data + 12);
+    unsigned char *copy = malloc(glb->length);
+    unsigned char *fgm_data = NULL;
+    size_t fgm_length;
+    int status = 0;
+
+    (void)fgm;
+
+    if (copy == NULL)
+        return fail("out of memory");
+
+    memcpy(copy, glb->data, glb->length);
+
+    /* the count of the first sparse accessor, keeping the JSON length */
+    for (size_t i = 20; i + 9 < 20 + (size_t)json_length && !status; i++) {
+        if (memcmp(copy + i, "\"sparse\"", 8) != 0)
+            continue;
+
+        for (size_t c = i; c > 20; c--) {
+            if (memcmp(copy + c, "\"count\":", 8) == 0) {
+                copy[c + 8] = copy[c + 8] == '1' ? '2' : '1';
+                status = 1;
+                break;
+            }
+        }
+    }
+
+    struct GLB_Options options = { GLB_FLAG_MORPH, NULL };
+
+    if (!status)
+        fail("no sparse accessor");
+    else if (FGM_Convert(copy, glb->length, &options, &fgm_data, &fgm_length))
+        status = fail("converted with an invalid morph target");
+
+    free(fgm_data);
+    free(copy);
+
+    return status;
+}
+
+static int check_sparse_stream(const Glb *glb, const Fgm *fgm)
+{
+    /* the mesh streams are copied from the BIN chunk as they are, so a
+     * sparse POSITION accessor fails the conversion instead of giving the
+     * zeros under its substitutions */
+
+    uint32_t json_length = read_u32(glb->data + 12);
+    const char *json = (const char*)glb->data + 20;
+    gJSON *primitive = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(
+                           gJSON_GetObjectItem(glb->json, "meshes"), 0), "primitives"), 0);
+    int position = get_int(gJSON_GetObjectItem(primitive, "attributes"), "POSITION", -1);
+    gJSON *accessors = gJSON_GetObjectItem(glb->json, "accessors");
+    int sparse = 0;
+    char from[32], to[32];
+    char *patched = NULL;
+    size_t at = 0;
+    Fgm converted;
+    int status = 1;
+
+    (void)fgm;
+
+    /* a target accessor, VEC3 floats with one element per vertex */
+    for (gJSON *item = gJSON_GetArrayItem(accessors, 0); item != NULL; item = item->next, sparse++)
+        if (gJSON_GetObjectItem(item, "sparse") != NULL)
+            break;
+
+    if (gJSON_GetArrayItem(accessors, sparse) == NULL)
+        return fail("no sparse accessor");
+
+    snprintf(from, sizeof(from), "\"POSITION\":%d", position);
+    snprintf(to, sizeof(to), "\"POSITION\":%d", sparse);
+
+    /* the first attribute using the positions of mesh 0 */
+    for (; at + strlen(from) < json_length; at++)
+        if (memcmp(json + at, from, strlen(from)) == 0 && (json[at + strlen(from)] < '0' || json[at + strlen(from)] > '9'))
+            break;
+
+    if (at + strlen(from) >= json_length)
+        return fail("POSITION of mesh 0 not found");
+
+    /* the same GLB rebuilt unchanged still converts */
+    if (!convert_json(glb, json, json_length, 0, &converted))
+        status = fail("the rebuilt GLB did not convert");
+    free(converted.data);
+
+    if ((patched = malloc(json_length + sizeof(to))) == NULL)
+        return fail("out of memory");
+
+    memcpy(patched, json, at);
+    memcpy(patched + at, to, strlen(to));
+    memcpy(patched + at + strlen(to), json + at + strlen(from), json_length - at - strlen(from));
+
+    if (status && convert_json(glb, patched, json_length - strlen(from) + strlen(to), 0, &converted))
+        status = fail("converted a mesh whose POSITION accessor is sparse");
+    free(converted.data);
+    free(patched);
+
+    return status;
+}
+
+/* parser checks, run once on documents written here rather than per file */
+
+static const char *json_document =
+    "{\"asset\":{\"version\":\"2.0\",\"extras\":{\"quote\":\"a\\\"b\\\\c\",\"empty\":{},\"none\":[]}},"
+    "\"numbers\":[0,-1,2.5,-0.125,1e3,1.5E-2,2147483647,-2147483648,4294967295,4294967296,1e300],"
+    "\"nested\":[[[1,[2,{\"deep\":[true,false,null]}]]],{\"a\":{\"b\":{\"c\":\"d\"}}}],"
+    "\"meshes\":[{\"name\":\"x\",\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}]}";
+
+static const char *json_malformed[] = {
+    "{\"a\":{\"b\":1,}}",
+    "{\"a\":[1,2}",
+    "{\"a\":{\"b\" 1}}",
+    "{\"a\":{\"b\":tru}}",
+    "{\"a\":[1,\"x]}",
+    "{\"a\":{1:2}}",
+    "{\"a\":[,1]}",
+    "{\"a\":[{\"b\":[1,2],}]}",
+    "{\"a\":[[\"b\",-]]}",
+    "{\"a\":{\"b\":{\"c\":[1]]}}",
+};
+
+static int same_tree(gJSON *eager, gJSON *lazy)
+{
+    /* compares through gJSON_GetArrayItem so that lazy children are built */
+
+    if ((eager == NULL) != (lazy == NULL))
+        return 0;
+    if (eager == NULL)
+        return 1;
+    if (eager->type != lazy->type || eager->valuedouble != lazy->valuedouble || eager->valueint != lazy->valueint)
+        return 0;
+    if ((eager->string == NULL) != (lazy->string == NULL) || (eager->string != NULL && strcmp(eager->string, lazy->string) != 0))
+        return 0;
+    if ((eager->valuestring == NULL) != (lazy->valuestring == NULL) ||
+        (eager->valuestring != NULL && strcmp(eager->valuestring, lazy->valuestring) != 0))
+        return 0;
+
+    gJSON *a = gJSON_GetArrayItem(eager, 0);
+    gJSON *b = gJSON_GetArrayItem(lazy, 0);
+
+    for (; a != NULL && b != NULL; a = a->next, b = b->next)
+        if (!same_tree(a, b))
+            return 0;
+
+    return a == NULL && b == NULL;
+}
+
+static int parses_nested(int depth, int lazy)
+{
+    /* {"a":[[...[1]...]]} with depth containers in all, walked down to
+     * the innermost value so that every level is expanded */
+
+    size_t length = (size_t) depth * 2 + 8;
+    unsigned char *text = malloc(length);
+    size_t at = 0;
+    int parsed = 0;
+
+    if (text == NULL)
+        return 0;
+
+    memcpy(text + at, "{\"a\":", 5);
+    at += 5;
+    for (int i = 1; i < depth; i++)
+        text[at++] = '[';
+    text[at++] = '1';
+    for (int i = 1; i < depth; i++)
+        text[at++] = ']';
+    text[at++] = '}';
+
+    gJSON *root = lazy ? gJSON_ParseLazy(text, at) : gJSON_ParseWithLength(text, at);
+    gJSON *item = gJSON_GetObjectItem(root, "a");
+
+    for (int i = 1; i < depth && item != NULL; i++)
+        item = gJSON_GetArrayItem(item, 0);
+
+    parsed = item != NULL && item->type == gJSON_Number && item->valueint == 1;
+
+    gJSON_Delete(root);
+    free(text);
+    return parsed;
+}
+
+static int check_lazy(void)
+{
+    const unsigned char *text = (const unsigned char*) json_document;
+    gJSON *eager = gJSON_ParseWithLength(text, strlen(json_document));
+    gJSON *lazy = gJSON_ParseLazy(text, strlen(json_document));
+    int deepest = 0;
+
+    if (eager == NULL || lazy == NULL)
+        fail("the document did not parse");
+    else if (!same_tree(eager, lazy))
+        fail("the lazy tree differs from the full one");
+    else {
+        gJSON *quote = gJSON_GetObjectItem(gJSON_GetObjectItem(gJSON_GetObjectItem(lazy, "asset"), "extras"), "quote");
+        if (quote == NULL || quote->valuestring == NULL || strcmp(quote->valuestring, "a\\\"b\\\\c") != 0)
+            fail("escaped string read as %s", quote != NULL && quote->valuestring != NULL ? quote->valuestring : "nothing");
+    }
+
+    gJSON_Delete(eager);
+    gJSON_Delete(lazy);
+
+    /* a syntax error anywhere fails the parse itself, not the first lookup
+     * that reaches it */
+    for (size_t i = 0; i < sizeof(json_malformed)/sizeof(json_malformed[0]); i++) {
+        const unsigned char *bad = (const unsigned char*) json_malformed[i];
+
+        eager = gJSON_ParseWithLength(bad, strlen(json_malformed[i]));
+        lazy = gJSON_ParseLazy(bad, strlen(json_malformed[i]));
+        if (eager != NULL || lazy != NULL)
+            fail("%s accepted by the %s parser", json_malformed[i], lazy != NULL ? "lazy" : "full");
+        gJSON_Delete(eager);
+        gJSON_Delete(lazy);
+    }
+
+    /* the nesting limit counts from the root whichever expansion builds a
+     * level, lazy and full parses stop at the same depth */
+    for (int depth = 2; depth <= 300; depth++) {
+        int full = parses_nested(depth, 0);
+
+        if (parses_nested(depth, 1) != full) {
+            fail("the lazy and full parsers disagree at %d levels", depth);
+            break;
+        }
+        if (full)
+            deepest = depth;
+    }
+
+    if (deepest < 8 || deepest >= 300)
+        fail("nesting stops at %d levels", deepest);
+
+    return 1;
+}
+
+static int same_text(const char *text, size_t length, const char *string)
+{
+    return text != NULL && string != NULL && strlen(string) == length && memcmp(text, string, length) == 0;
+}
+
+static int same_tape(const gJSON_Tape *tape, uint32_t index, gJSON *item)
+{
+    /* the entry against the node of the full tree, then the children
+     * reached both by walking and by lookup */
+
+    int type = gJSON_TapeType(tape, index);
+    size_t length;
+
+    if (type != item->type)
+        return 0;
+    if (type == gJSON_Number && (gJSON_TapeNumber(tape, index) != item->valuedouble || gJSON_TapeInt(tape, index) != item->valueint))
+        return 0;
+    if (type == gJSON_String) {
+        const char *text = gJSON_TapeString(tape, index, &length);
+        if (!same_text(text, length, item->valuestring))
+            return 0;
+    }
+
+    uint32_t child = gJSON_TapeChild(tape, index);
+    int count = 0;
+
+    for (gJSON *node = item->child; node != NULL; node = node->next, count++) {
+        if (child == GJSON_TAPE_NONE || !same_tape(tape, child, node))
+            return 0;
+
+        if (type == gJSON_Array && gJSON_TapeGetArrayItem(tape, index, count) != child)
+            return 0;
+
+        if (type == gJSON_Object) {
+            const char *key = gJSON_TapeKey(tape, child, &length);
+            if (!same_text(key, length, node->string) || gJSON_TapeGetObjectItem(tape, index, node->string) != child)
+                return 0;
+        }
+
+        child = gJSON_TapeNext(tape, child);
+    }
+
+    if (child != GJSON_TAPE_NONE || gJSON_TapeGetArrayItem(tape, index, count) != GJSON_TAPE_NONE)
+        return 0;
+
+    return type == gJSON_Object || type == gJSON_Array ? (uint32_t) count == tape->entries[index].value : 1;
+}
+
+static int check_tape(void)
+{
+    const unsigned char *text = (const unsigned char*) json_document;
+    gJSON *tree = gJSON_ParseWithLength(text, strlen(json_document));
+    gJSON_Tape tape;
+
+    if (tree == NULL || !gJSON_TapeParse(&tape, text, strlen(json_document)))
+        fail("the document did not parse");
+    else {
+        if (!same_tape(&tape, 0, tree))
+            fail("the tape differs from the tree");
+        if (gJSON_TapeGetObjectItem(&tape, 0, "missing") != GJSON_TAPE_NONE ||
+            gJSON_TapeGetArrayItem(&tape, gJSON_TapeGetObjectItem(&tape, 0, "numbers"), -1) != GJSON_TAPE_NONE)
+            fail("a missing item was found");
+        gJSON_TapeFree(&tape);
+    }
+
+    gJSON_Delete(tree);
+
+    for (size_t i = 0; i < sizeof(json_malformed)/sizeof(json_malformed[0]); i++) {
+        if (gJSON_TapeParse(&tape, (const unsigned char*) json_malformed[i], strlen(json_malformed[i]))) {
+            fail("%s accepted", json_malformed[i]);
+            gJSON_TapeFree(&tape);
+        }
+    }
+
+    return 1;
+}
+
+static const struct
+{
+    const char *name;
+    int (*run)(void);
+} parser_checks[] = {
+    { "lazy", check_lazy },
+    { "tape", check_tape },
+};
+
+static const struct
+{
+    const char *name;
+    uint32_t flags;
+    const char *requires; /* glTF property of the document or of its first mesh, NULL for every file */
+    int (*run)(const Glb*, const Fgm*);
+} checks[] = {
+    { "streams", 0, NULL, check_streams },
+    { "stream-convert", 0, NULL, check_stream_convert },
+    { "stream-invalid", 0, NULL, check_stream_invalid },
+    { "share", GLB_FLAG_SHARE, NULL, check_share },
+    { "share-content", GLB_FLAGS_SHARE, NULL, check_share_content },
+    { "skin", GLB_FLAG_SKIN, "skins", check_skin },
+    { "anim", GLB_FLAG_ANIM, "animations", check_anim },
+    { "anim-invalid", 0, "animations", check_anim_invalid },
+    { "bvh", GLB_FLAG_BVH, NULL, check_bvh },
+    { "bvh-invalid", 0, NULL, check_bvh_invalid },
+    { "tangents", GLB_FLAG_TANGENTS, NULL, check_tangents },
+    { "tangents-invalid", 0, NULL, check_tangents_invalid },
+    { "reuse", 0, NULL, check_reuse },
+    { "flatten", GLB_FLAG_FLATTEN, "nodes", check_flatten },
+    { "textures", GLB_FLAG_TEXTURES, "images", check_textures },
+    { "morph", GLB_FLAG_MORPH, "weights", check_morph },
+    { "morph-invalid", 0, "weights", check_morph_invalid },
+    { "sparse-stream", 0, "weights", check_sparse_stream },
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("usage: check file.glb...\n");
+        return 1;
+    }
+
+    current_file = "gjson";
+
+    for (size_t c = 0; c < sizeof(parser_checks)/sizeof(parser_checks[0]); c++) {
+        int before = failures;
+
+        current_check = parser_checks[c].name;
+        parser_checks[c].run();
+        printf("check : gjson %s %s\n", parser_checks[c].name, failures == before ? "ok" : "FAILED");
+    }
+
+    for (int i = 1; i < argc; i++) {
+        Glb glb;
+
+        current_file = argv[i];
+        current_check = "load";
+
+        if (!load_glb(&glb, argv[i])) {
+            fail("could not read the GLB");
+            free_glb(&glb);
+            continue;
+        }
+
+        for (size_t c = 0; c < sizeof(checks)/sizeof(checks[0]); c++) {
+            Fgm fgm;
+
+            gJSON *first_mesh = gJSON_GetArrayItem(gJSON_GetObjectItem(glb.json, "meshes"), 0);
+
+            if (checks[c].requires != NULL && gJSON_GetObjectItem(glb.json, checks[c].requires) == NULL &&
+                gJSON_GetObjectItem(first_mesh, checks[c].requires) == NULL)
+                continue;
+
+            current_check = checks[c].name;
+
+            int before = failures;
+            if (convert(&glb, checks[c].flags, &fgm))
+                checks[c].run(&glb, &fgm);
+            free(fgm.data);
+
+            printf("check : %s %s %s\n", argv[i], checks[c].name, failures == before ? "ok" : "FAILED");
+        }
+
+        free_glb(&glb);
+    }
+
+    return failures > 0;
+}
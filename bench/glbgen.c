@@ -0,0 +1,506 @@
+/* Synthetic GLB generator for the benchmark suite and the checks. Writes a
+ * file with a configurable number of meshes, vertices per mesh and extra
+ * accessors so the JSON chunk, the accessor count and the BIN chunk can be
+ * scaled independently.
+ *
+ *    glbgen [-m meshes] [-v vertices] [-a extra accessors] [-s seed] [-n] [-k] [-A] [-P] [-i] [-S]
+ *           [-M] [-T] -o out.glb
+ *
+ * The optional parts hold known values that bench/check.c compares the
+ * converted sections against :
+ *
+ *    -n  one node per mesh, node m transformed by the m % 4 case : none,
+ *        translation (1, 2, 3), rotation of 30 degrees around Z, scale (-1, 1, 1)
+ *    -k  two joint nodes after the mesh nodes and one skin using them, its
+ *        inverse bind matrix j translating by (-j, 0, 0). Every mesh has
+ *        JOINTS_0 (v % 2, (v + 1) % 2, 0, 0) and WEIGHTS_0 (0.6, 0.4, 0, 0)
+ *        for vertex v, only node 0 uses the skin
+ *    -A  one animation : translation of node 0 through (0, 0, 0), (1, 2, 3),
+ *        (2, 0, -2) at 0, 0.5 and 1 second, constant scale (2, 2, 2) of node 0
+ *        and rotation of the last node from the identity to 90 degrees around Z
+ *        in one second, all linear
+ *    -P  two materials, every mesh having a second primitive with the same
+ *        attributes and indices, the first one using material 0 and the
+ *        second material 1
+ *    -i  four images : a 4x2 PNG, a 3x5 JPEG, 12 bytes of KTX2 and one
+ *        referenced by uri, only their headers being valid
+ *    -S  bufferViews shared like some exporters write them : one view holds
+ *        the POSITION of every mesh at increasing accessor byteOffsets, the
+ *        NORMAL and TEXCOORD_0 of a mesh are interleaved in one view with a
+ *        byteStride of 20 and meshes 2k and 2k + 1 use the same index accessor
+ *    -M  one morph target on the first primitive of every mesh, default weight
+ *        0.5 : a sparse POSITION accessor without bufferView moving vertex 1
+ *        by (0.5, -0.25, 1) and vertex 3 by (-1, 0, 0.125), and a NORMAL one
+ *        moving every vertex v with v % 4 == 0 by (0, 0, 0.5)
+ *    -T  flat ribbons with known tangents instead of random attributes :
+ *        vertex v at (v / 2, v % 2, 0) with normal (0, 0, 1) and texcoord
+ *        (|c - s| / columns, v % 2) where c = v / 2, columns = (vertices + 1) / 2
+ *        and s = columns / 2, the UVs being mirrored at column s. Columns
+ *        before s have tangent (-1, 0, 0) and handedness -1, those after
+ *        it (1, 0, 0) and 1. Not with -S
+ *
+ * -k and -A imply -n. The JSON is written without whitespace, like most
+ * exporters do. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+typedef struct
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} Bytes;
+
+static void bytes_append(Bytes *b, const void *data, size_t length)
+{
+    if (b->length + length > b->capacity) {
+        while (b->length + length > b->capacity)
+            b->capacity = b->capacity ? b->capacity*2 : 4096;
+        b->data = realloc(b->data, b->capacity);
+    }
+
+    memcpy(b->data + b->length, data, length);
+    b->length += length;
+}
+
+static void bytes_printf(Bytes *b, const char *fmt, ...)
+{
+    char text[512];
+    va_list args;
+    int length;
+
+    va_start(args, fmt);
+    length = vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    bytes_append(b, text, (size_t)length);
+}
+
+static void bytes_pad(Bytes *b, unsigned char value)
+{
+    while (b->length % 4)
+        bytes_append(b, &value, 1);
+}
+
+static uint32_t next_random(uint32_t *state)
+{
+    /* xorshift32, good enough for filler data */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static float random_float(uint32_t *state)
+{
+    return (float)(next_random(state) & 0xFFFFFF) / (float)0xFFFFFF * 2.0f - 1.0f;
+}
+
+typedef struct
+{
+    Bytes accessors;
+    Bytes views;
+    Bytes bin;
+    int count;
+    int view_count;
+} Accessors;
+
+static int add_view(Accessors *a, const void *data, size_t length, int stride)
+{
+    /* returns the index of the bufferView, stride 0 for packed elements */
+    size_t offset = a->bin.length;
+
+    bytes_append(&a->bin, data, length);
+    bytes_pad(&a->bin, 0);
+
+    bytes_printf(&a->views, "%s{\"buffer\":0,\"byteLength\":%lu,\"byteOffset\":%lu", a->view_count > 0 ? "," : "",
+                 (unsigned long)length, (unsigned long)offset);
+    if (stride > 0)
+        bytes_printf(&a->views, ",\"byteStride\":%d", stride);
+    bytes_printf(&a->views, "}");
+
+    return a->view_count++;
+}
+
+static int add_accessor_at(Accessors *a, int view, size_t offset, int element_count, int component_type,
+                           const char *type)
+{
+    /* an accessor reading view from offset, returns its index */
+    if (a->count > 0)
+        bytes_printf(&a->accessors, ",");
+    bytes_printf(&a->accessors, "{\"bufferView\":%d,", view);
+    if (offset > 0)
+        bytes_printf(&a->accessors, "\"byteOffset\":%lu,", (unsigned long)offset);
+    bytes_printf(&a->accessors, "\"componentType\":%d,\"count\":%d,\"type\":\"%s\"", component_type,
+                 element_count, type);
+
+    /* min/max are written for VEC3 like exporters do, the converter skips them */
+    if (strcmp(type, "VEC3") == 0)
+        bytes_printf(&a->accessors, ",\"min\":[-1.0,-1.0,-1.0],\"max\":[1.0,1.0,1.0]");
+    bytes_printf(&a->accessors, "}");
+
+    return a->count++;
+}
+
+static int add_accessor(Accessors *a, const void *data, size_t length, int element_count, int component_type,
+                        const char *type)
+{
+    /* one bufferView per accessor like most exporters write */
+    return add_accessor_at(a, add_view(a, data, length, 0), 0, element_count, component_type, type);
+}
+
+static int add_sparse_accessor(Accessors *a, int element_count, const uint16_t *indices, const float *values,
+                               int count)
+{
+    /* VEC3 float accessor without bufferView, zero but for count elements */
+    int indices_view = add_view(a, indices, sizeof(uint16_t)*count, 0);
+    int values_view = add_view(a, values, sizeof(float)*3*count, 0);
+
+    if (a->count > 0)
+        bytes_printf(&a->accessors, ",");
+    bytes_printf(&a->accessors, "{\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\",\"sparse\":{\"count\":%d,"
+                 "\"indices\":{\"bufferView\":%d,\"componentType\":5123},\"values\":{\"bufferView\":%d}}}",
+                 element_count, count, indices_view, values_view);
+
+    return a->count++;
+}
+
+static void add_nodes(Bytes *json, int meshes, int skin)
+{
+    /* the transforms listed at the top of the file */
+    static const char *transforms[4] = {
+        "",
+        ",\"translation\":[1.0,2.0,3.0]",
+        ",\"rotation\":[0.0,0.0,0.25881904,0.96592583]",
+        ",\"scale\":[-1.0,1.0,1.0]",
+    };
+
+    bytes_printf(json, ",\"nodes\":[");
+    for (int m = 0; m < meshes; m++) {
+        bytes_printf(json, "%s{\"name\":\"node_%d\",\"mesh\":%d%s%s}", m > 0 ? "," : "", m, m,
+                     transforms[m % 4], skin && m == 0 ? ",\"skin\":0" : "");
+    }
+    if (skin)
+        bytes_printf(json, ",{\"name\":\"joint_0\",\"children\":[%d]},{\"name\":\"joint_1\"}", meshes + 1);
+    bytes_printf(json, "]");
+
+    bytes_printf(json, ",\"scene\":0,\"scenes\":[{\"nodes\":[");
+    for (int m = 0; m < meshes; m++)
+        bytes_printf(json, "%s%d", m > 0 ? "," : "", m);
+    if (skin)
+        bytes_printf(json, ",%d", meshes);
+    bytes_printf(json, "]}]");
+}
+
+static void add_skin(Bytes *json, Accessors *a, int meshes)
+{
+    float matrices[32];
+
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 16; i++)
+            matrices[j*16 + i] = i % 5 == 0 ? 1.0f : 0.0f;
+        matrices[j*16 + 12] = (float)-j;
+    }
+
+    int ibm = add_accessor(a, matrices, sizeof(matrices), 2, 5126, "MAT4");
+
+    bytes_printf(json, ",\"skins\":[{\"joints\":[%d,%d],\"inverseBindMatrices\":%d,\"skeleton\":%d}]", meshes,
+                 meshes + 1, ibm, meshes);
+}
+
+static void add_animation(Bytes *json, Accessors *a, int last_node)
+{
+    float times[3] = { 0.0f, 0.5f, 1.0f };
+    float translations[9] = { 0, 0, 0, 1, 2, 3, 2, 0, -2 };
+    float scales[6] = { 2, 2, 2, 2, 2, 2 };
+    float rotations[8] = { 0, 0, 0, 1, 0, 0, 0.70710678f, 0.70710678f };
+    float ends[2] = { 0.0f, 1.0f };
+
+    int input = add_accessor(a, times, sizeof(times), 3, 5126, "SCALAR");
+    int translation = add_accessor(a, translations, sizeof(translations), 3, 5126, "VEC3");
+    int ends_input = add_accessor(a, ends, sizeof(ends), 2, 5126, "SCALAR");
+    int scale = add_accessor(a, scales, sizeof(scales), 2, 5126, "VEC3");
+    int rotation = add_accessor(a, rotations, sizeof(rotations), 2, 5126, "VEC4");
+
+    bytes_printf(json, ",\"animations\":[{\"name\":\"glbgen\",\"channels\":["
+                 "{\"sampler\":0,\"target\":{\"node\":0,\"path\":\"translation\"}},"
+                 "{\"sampler\":1,\"target\":{\"node\":0,\"path\":\"scale\"}},"
+                 "{\"sampler\":2,\"target\":{\"node\":%d,\"path\":\"rotation\"}}],\"samplers\":["
+                 "{\"input\":%d,\"output\":%d,\"interpolation\":\"LINEAR\"},"
+                 "{\"input\":%d,\"output\":%d,\"interpolation\":\"LINEAR\"},"
+                 "{\"input\":%d,\"output\":%d,\"interpolation\":\"LINEAR\"}]}]",
+                 last_node, input, translation, ends_input, scale, ends_input, rotation);
+}
+
+static void add_images(Bytes *json, Accessors *a)
+{
+    /* a PNG and a JPEG with just enough of a header to be measured, bytes
+     * of another format and an image referenced by uri */
+    static const unsigned char png[33] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R',
+        0, 0, 0, 4, 0, 0, 0, 2, 8, 6, 0, 0, 0, 0x12, 0x34, 0x56, 0x78,
+    };
+    static const unsigned char jpeg[27] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0, 6, 'J', 'F', 'I', 'F', 0xFF, 0xC0, 0, 11, 8, 0, 5, 0, 3, 1, 1, 0x11, 0,
+        0xFF, 0xD9, 0, 0,
+    };
+    static const unsigned char other[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    int png_view = add_view(a, png, sizeof(png), 0);
+    int jpeg_view = add_view(a, jpeg, sizeof(jpeg), 0);
+    int other_view = add_view(a, other, sizeof(other), 0);
+
+    bytes_printf(json, ",\"images\":[{\"bufferView\":%d,\"mimeType\":\"image/png\"},"
+                 "{\"bufferView\":%d,\"mimeType\":\"image/jpeg\"},{\"bufferView\":%d,\"mimeType\":\"image/ktx2\"},"
+                 "{\"uri\":\"glbgen.png\"}]", png_view, jpeg_view, other_view);
+}
+
+int main(int argc, char *argv[])
+{
+    int meshes = 16;
+    int vertices = 1024;
+    int extra = 0;
+    int nodes = 0, skin = 0, animation = 0, primitives = 0, images = 0, shared = 0, morph = 0, ribbon = 0;
+    uint32_t seed = 0x9E3779B9;
+    const char *out = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            meshes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+            vertices = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+            extra = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-n") == 0)
+            nodes = 1;
+        else if (strcmp(argv[i], "-k") == 0)
+            nodes = skin = 1;
+        else if (strcmp(argv[i], "-A") == 0)
+            nodes = animation = 1;
+        else if (strcmp(argv[i], "-P") == 0)
+            primitives = 1;
+        else if (strcmp(argv[i], "-i") == 0)
+            images = 1;
+        else if (strcmp(argv[i], "-S") == 0)
+            shared = 1;
+        else if (strcmp(argv[i], "-M") == 0)
+            morph = 1;
+        else if (strcmp(argv[i], "-T") == 0)
+            ribbon = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out = argv[++i];
+        else
+            out = NULL, i = argc;
+    }
+
+    if (out == NULL || meshes <= 0 || meshes > 65535 || vertices < 3 || (morph && vertices < 4) || (ribbon && shared)) {
+        printf("usage: glbgen [-m meshes] [-v vertices] [-a extra accessors] [-s seed] [-n] [-k] [-A] [-P] "
+               "[-i] [-S] [-M] [-T] -o out.glb\n");
+        return 1;
+    }
+
+    int triangles = vertices - 2;
+    int wide = vertices > 65535;
+    size_t index_size = wide ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    float *floats = malloc(sizeof(float)*5*vertices);
+    unsigned char *indices = malloc(index_size*3*triangles);
+
+    Accessors a = { 0 };
+    Bytes meshes_json = { 0 }, json = { 0 };
+    int positions_view = 0, shared_indices = 0;
+
+    if (shared) {
+        float *positions = malloc(sizeof(float)*3*vertices*(size_t)meshes);
+
+        for (size_t i = 0; i < 3*(size_t)vertices*meshes; i++)
+            positions[i] = random_float(&seed);
+        positions_view = add_view(&a, positions, sizeof(float)*3*vertices*(size_t)meshes, 0);
+        free(positions);
+    }
+
+    for (int m = 0; m < meshes; m++) {
+        int attributes[4], joints = 0, weights = 0, first_extra, targets[2] = { 0, 0 };
+
+        /* POSITION, NORMAL, TEXCOORD_0, indices then the extra accessors */
+        if (shared) {
+            attributes[0] = add_accessor_at(&a, positions_view, sizeof(float)*3*vertices*(size_t)m, vertices, 5126,
+                                            "VEC3");
+
+            for (int v = 0; v < vertices; v++) {
+                for (int i = 0; i < 3; i++)
+                    floats[v*5 + i] = random_float(&seed);
+                floats[v*5 + 3] = random_float(&seed)*0.5f + 0.5f;
+                floats[v*5 + 4] = random_float(&seed)*0.5f + 0.5f;
+            }
+            int view = add_view(&a, floats, sizeof(float)*5*vertices, 20);
+            attributes[1] = add_accessor_at(&a, view, 0, vertices, 5126, "VEC3");
+            attributes[2] = add_accessor_at(&a, view, 12, vertices, 5126, "VEC2");
+        } else if (ribbon) {
+            int columns = (vertices + 1)/2;
+
+            for (int v = 0; v < vertices; v++) {
+                floats[v*3] = (float)(v/2);
+                floats[v*3 + 1] = (float)(v % 2);
+                floats[v*3 + 2] = 0.0f;
+            }
+            attributes[0] = add_accessor(&a, floats, sizeof(float)*3*vertices, vertices, 5126, "VEC3");
+
+            for (int v = 0; v < vertices; v++) {
+                floats[v*3] = floats[v*3 + 1] = 0.0f;
+                floats[v*3 + 2] = 1.0f;
+            }
+            attributes[1] = add_accessor(&a, floats, sizeof(float)*3*vertices, vertices, 5126, "VEC3");
+
+            for (int v = 0; v < vertices; v++) {
+                floats[v*2] = (float)abs(v/2 - columns/2)/(float)columns;
+                floats[v*2 + 1] = (float)(v % 2);
+            }
+            attributes[2] = add_accessor(&a, floats, sizeof(float)*2*vertices, vertices, 5126, "VEC2");
+        } else {
+            for (int i = 0; i < vertices*3; i++)
+                floats[i] = random_float(&seed);
+            attributes[0] = add_accessor(&a, floats, sizeof(float)*3*vertices, vertices, 5126, "VEC3");
+
+            for (int i = 0; i < vertices*3; i++)
+                floats[i] = random_float(&seed);
+            attributes[1] = add_accessor(&a, floats, sizeof(float)*3*vertices, vertices, 5126, "VEC3");
+
+            for (int i = 0; i < vertices*2; i++)
+                floats[i] = random_float(&seed)*0.5f + 0.5f;
+            attributes[2] = add_accessor(&a, floats, sizeof(float)*2*vertices, vertices, 5126, "VEC2");
+        }
+
+        if (shared && m % 2 == 1) {
+            attributes[3] = shared_indices;
+        } else {
+            /* triangle strip unrolled into a list */
+            for (int t = 0; t < triangles; t++) {
+                uint32_t tri[3] = { (uint32_t)t, (uint32_t)(t + 1 + (t & 1)), (uint32_t)(t + 2 - (t & 1)) };
+
+                for (int k = 0; k < 3; k++) {
+                    if (wide) {
+                        memcpy(indices + (t*3 + k)*index_size, &tri[k], index_size);
+                    } else {
+                        uint16_t small = (uint16_t)tri[k];
+                        memcpy(indices + (t*3 + k)*index_size, &small, index_size);
+                    }
+                }
+            }
+            attributes[3] = add_accessor(&a, indices, index_size*3*triangles, triangles*3, wide ? 5125 : 5123,
+                                         "SCALAR");
+            shared_indices = attributes[3];
+        }
+
+        first_extra = a.count;
+        for (int e = 0; e < extra; e++) {
+            for (int i = 0; i < vertices*4; i++)
+                floats[i] = random_float(&seed);
+            add_accessor(&a, floats, sizeof(float)*4*vertices, vertices, 5126, "VEC4");
+        }
+
+        if (skin) {
+            unsigned char *packed = (unsigned char*)floats;
+
+            for (int v = 0; v < vertices; v++) {
+                packed[v*4] = (unsigned char)(v % 2);
+                packed[v*4 + 1] = (unsigned char)((v + 1) % 2);
+                packed[v*4 + 2] = packed[v*4 + 3] = 0;
+            }
+            joints = add_accessor(&a, packed, 4*(size_t)vertices, vertices, 5121, "VEC4");
+
+            for (int v = 0; v < vertices; v++) {
+                floats[v*4] = 0.6f;
+                floats[v*4 + 1] = 0.4f;
+                floats[v*4 + 2] = floats[v*4 + 3] = 0.0f;
+            }
+            weights = add_accessor(&a, floats, sizeof(float)*4*vertices, vertices, 5126, "VEC4");
+        }
+
+        if (morph) {
+            uint16_t moved[2] = { 1, 3 };
+            float deltas[6] = { 0.5f, -0.25f, 1.0f, -1.0f, 0.0f, 0.125f };
+
+            targets[0] = add_sparse_accessor(&a, vertices, moved, deltas, 2);
+
+            for (int v = 0; v < vertices; v++) {
+                floats[v*3] = floats[v*3 + 1] = 0.0f;
+                floats[v*3 + 2] = v % 4 == 0 ? 0.5f : 0.0f;
+            }
+            targets[1] = add_accessor(&a, floats, sizeof(float)*3*vertices, vertices, 5126, "VEC3");
+        }
+
+        if (m > 0)
+            bytes_printf(&meshes_json, ",");
+        bytes_printf(&meshes_json, "{\"name\":\"mesh_%d\",\"primitives\":[{\"attributes\":{\"POSITION\":%d,"
+                     "\"NORMAL\":%d,\"TEXCOORD_0\":%d", m, attributes[0], attributes[1], attributes[2]);
+        for (int e = 0; e < extra; e++)
+            bytes_printf(&meshes_json, ",\"_EXTRA_%d\":%d", e, first_extra + e);
+        if (skin)
+            bytes_printf(&meshes_json, ",\"JOINTS_0\":%d,\"WEIGHTS_0\":%d", joints, weights);
+        bytes_printf(&meshes_json, "},\"indices\":%d,%s", attributes[3], primitives ? "\"material\":0," : "");
+        if (morph)
+            bytes_printf(&meshes_json, "\"targets\":[{\"POSITION\":%d,\"NORMAL\":%d}],", targets[0], targets[1]);
+        bytes_printf(&meshes_json, "\"extras\":{\"generator\":\"glbgen\",\"seed\":%u%s}}", seed,
+                     ribbon ? ",\"ribbon\":true" : "");
+        if (primitives)
+            bytes_printf(&meshes_json, ",{\"attributes\":{\"POSITION\":%d,\"NORMAL\":%d,\"TEXCOORD_0\":%d},"
+                         "\"indices\":%d,\"material\":1}", attributes[0], attributes[1], attributes[2], attributes[3]);
+        bytes_printf(&meshes_json, morph ? "],\"weights\":[0.5]}" : "]}");
+    }
+
+    bytes_printf(&json, "{\"asset\":{\"generator\":\"glbgen\",\"version\":\"2.0\"},\"meshes\":[");
+    bytes_append(&json, meshes_json.data, meshes_json.length);
+    bytes_printf(&json, "]");
+
+    if (primitives)
+        bytes_printf(&json, ",\"materials\":[{\"name\":\"material_0\"},{\"name\":\"material_1\"}]");
+    if (nodes)
+        add_nodes(&json, meshes, skin);
+    if (skin)
+        add_skin(&json, &a, meshes);
+    if (animation)
+        add_animation(&json, &a, meshes + 2*skin - 1);
+    if (images)
+        add_images(&json, &a);
+
+    bytes_printf(&json, ",\"accessors\":[");
+    bytes_append(&json, a.accessors.data, a.accessors.length);
+    bytes_printf(&json, "],\"bufferViews\":[");
+    bytes_append(&json, a.views.data, a.views.length);
+    bytes_printf(&json, "],\"buffers\":[{\"byteLength\":%lu}]}", (unsigned long)a.bin.length);
+    bytes_pad(&json, ' ');
+
+    FILE *fp = fopen(out, "wb");
+    if (fp == NULL) {
+        printf("glbgen : could not open %s\n", out);
+        return 1;
+    }
+
+    uint32_t header[3] = { 0x46546C67, 2, (uint32_t)(12 + 8 + json.length + 8 + a.bin.length) };
+    uint32_t json_header[2] = { (uint32_t)json.length, 0x4E4F534A };
+    uint32_t bin_header[2] = { (uint32_t)a.bin.length, 0x004E4942 };
+
+    fwrite(header, sizeof(header), 1, fp);
+    fwrite(json_header, sizeof(json_header), 1, fp);
+    fwrite(json.data, json.length, 1, fp);
+    fwrite(bin_header, sizeof(bin_header), 1, fp);
+    fwrite(a.bin.data, a.bin.length, 1, fp);
+    fclose(fp);
+
+    free(floats);
+    free(indices);
+    free(a.accessors.data);
+    free(a.views.data);
+    free(a.bin.data);
+    free(meshes_json.data);
+    free(json.data);
+
+    return 0;
+}
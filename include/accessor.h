@@ -0,0 +1,41 @@
+/* Typed reads of glTF accessors. They follow the accessor's bufferView,
+ * byteOffset and byteStride like the mesh streams do, but also apply sparse
+ * substitutions and convert (normalized) integers to what the caller asks,
+ * where the mesh streams keep the bytes as they are */
+
+#ifndef __GLB_ACCESSOR__
+#define __GLB_ACCESSOR__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+
+typedef struct
+{
+    const unsigned char *data; /* first element, NULL when the accessor has no bufferView */
+    int count;
+    int components;     /* 1 for SCALAR up to 16 for MAT4 */
+    int component_type; /* 5120 to 5126 */
+    int component_size;
+    int normalized;
+    size_t stride;      /* bytes from one element to the next */
+
+    /* sparse accessors, elements replacing those at the given indices */
+    int sparse_count;
+    int sparse_index_type;
+    const unsigned char *sparse_indices;
+    const unsigned char *sparse_values; /* tightly packed */
+} GLB_Accessor;
+
+int GLB_GetBufferView(gJSON *gson, int index, const unsigned char *bin, size_t bin_length,
+                      const unsigned char **data, size_t *length);
+int GLB_GetAccessor(GLB_Accessor*, gJSON *gson, int index, const unsigned char *bin, size_t bin_length);
+
+/* data stays NULL, offset receives where the first element is in the BIN chunk */
+int GLB_GetAccessorRange(GLB_Accessor*, gJSON *gson, int index, uint64_t bin_length, uint64_t *offset);
+
+float *GLB_ReadFloats(const GLB_Accessor*, int components);
+uint32_t *GLB_ReadUints(const GLB_Accessor*, int components);
+
+#endif
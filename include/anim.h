@@ -0,0 +1,34 @@
+/* Skinning and animation sections. Skins become packed per-vertex streams
+ * (4 uint8 joints, 4 unorm8 weights) with their inverse bind matrices and
+ * animations are resampled at a fixed frame rate into quantized tracks so
+ * a pose is an array lookup per frame. Layouts are in the format file */
+
+#ifndef __FGM_ANIM__
+#define __FGM_ANIM__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+#include "fgm.h"
+
+#define FGM_SECTION_SKIN "SKIN"
+#define FGM_SECTION_ANIM "ANIM"
+
+enum FGM_AnimPath
+{
+    FGM_PATH_TRANSLATION,
+    FGM_PATH_ROTATION,
+    FGM_PATH_SCALE,
+};
+
+#define FGM_TRACK_CONSTANT 1 /* a single frame is stored */
+
+/* longest animation resampled, 4.8 hours at 60 fps. Longer ones, and NaN or
+ * infinite key times, fail the section rather than wrapping the frame count */
+#define FGM_ANIM_MAX_FRAMES (1 << 20)
+
+int FGM_BuildSkins(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes);
+int FGM_BuildAnimations(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length, int fps);
+
+#endif
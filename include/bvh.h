@@ -0,0 +1,33 @@
+/* Triangle BVH per mesh, built with binned SAH so hit and ray queries can
+ * use it straight from the file. Nodes are stored depth first : the left
+ * child of an interior node directly follows it. Layout in the format file */
+
+#ifndef __FGM_BVH__
+#define __FGM_BVH__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+#include "fgm.h"
+
+#define FGM_SECTION_BVH "BVH "
+
+#define FGM_BVH_BINS 16
+#define FGM_BVH_LEAF_SIZE 8          /* a leaf never holds more unless the triangles can not be split */
+#define FGM_BVH_PARALLEL 65536       /* meshes with fewer triangles are built on one thread */
+
+/* 32 bytes, interior nodes have count 0 and right is their second child */
+typedef struct
+{
+    float min[3];
+    uint32_t right_or_first; /* first triangle for a leaf */
+    float max[3];
+    uint32_t count;
+} FGM_BVHNode;
+
+/* reuse is optional, meshes it maps to a previous output are copied */
+int FGM_BuildBVH(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes,
+                 int threads, FGM_Reuse *reuse);
+
+#endif
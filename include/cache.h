@@ -0,0 +1,50 @@
+/* Conversion cache. A manifest file records the hash of every converted
+ * input, the options it was converted with, the output written and the
+ * hash of each mesh, so unchanged inputs are skipped and the per-mesh
+ * sections of unchanged meshes are copied from the previous output.
+ * FGM_CACHE_VERSION is part of the options hash and goes up whenever the
+ * same input and options would give a different output */
+
+#ifndef __FGM_CACHE__
+#define __FGM_CACHE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FGM_CACHE_VERSION 9
+#define FGM_CACHE_DEFAULT ".fgmcache"
+
+struct CacheEntry {
+    char *input;
+    char *output;       /* absolute, entries are keyed on it */
+
+    uint64_t input_hash;
+    uint64_t options_hash;
+    uint64_t output_hash;
+    uint64_t output_size;
+
+    int num_meshes;     /* GLB_Meshes.hashes of the conversion, 0 without */
+    uint64_t *mesh_hashes;
+
+    int updated;        /* set by FGM_CacheUpdate, written back by FGM_CacheSave */
+};
+
+struct Cache {
+    char *path;
+    struct CacheEntry *entries;
+    int count;
+};
+
+int FGM_CacheLoad(struct Cache*, const char *path);
+
+/* merges the updated entries into the manifest as it is on disk, under a
+ * lock, so converters sharing a manifest keep each other's entries */
+int FGM_CacheSave(struct Cache*);
+void FGM_CacheFree(struct Cache*);
+
+struct CacheEntry *FGM_CacheFind(struct Cache*, const char *output);
+struct CacheEntry *FGM_CacheUpdate(struct Cache*, const char *input, const char *output);
+
+int FGM_HashFile(const char *path, uint64_t *hash, uint64_t *size);
+
+#endif
@@ -0,0 +1,67 @@
+/* In-process conversion of a GLB held in memory into an FGM (see the
+ * format file). Nothing here keeps state between calls so conversions
+ * can run on several threads at once */
+
+#ifndef __FGM_CONVERT__
+#define __FGM_CONVERT__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glb.h"
+
+#define FGM_SECTION_ALIGN 16
+#define FGM_SECTION_MAGIC "FGMX"
+
+/* growable byte buffer used to build sections, an allocation failure is
+ * remembered and reported when the section is added */
+typedef struct
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} FGM_Bytes;
+
+size_t FGM_BytesAppend(FGM_Bytes*, const void *data, size_t length);
+size_t FGM_BytesAlign(FGM_Bytes*, size_t alignment);
+void FGM_BytesPatch(FGM_Bytes*, size_t offset, const void *data, size_t length);
+
+int FGM_AddSection(struct GLB_Meshes*, const char *tag, FGM_Bytes*);
+
+/* Lets a per-mesh section builder copy a mesh from the same section of a
+ * previous output. previous[m] is the mesh of that output whose inputs
+ * hashed like those of mesh m, -1 when there is none. reused counts the
+ * meshes copied */
+typedef struct
+{
+    const unsigned char *section;
+    size_t length;
+    const int *previous;
+    int reused;
+} FGM_Reuse;
+
+size_t FGM_Size(const struct GLB_Meshes*);
+size_t FGM_Write(const struct GLB_Meshes*, unsigned char *dst);
+
+int FGM_Convert(const unsigned char *glb, size_t length, const struct GLB_Options*,
+                unsigned char **fgm, size_t *fgm_length);
+int FGM_ConvertInto(const unsigned char *glb, size_t length, const struct GLB_Options*,
+                    unsigned char *dst, size_t capacity, size_t *fgm_length);
+
+/* Streams the BIN chunk when no flag is set and the streams are neither
+ * interleaved nor out of order. Otherwise up to the whole GLB is held in
+ * memory, bounded by the length in its header. JSON chunks longer than
+ * FGM_STREAM_MAX_JSON are refused */
+#define FGM_STREAM_MAX_JSON (256u << 20)
+
+int FGM_ConvertStream(FILE *in, FILE *out, const struct GLB_Options*);
+
+unsigned char *FGM_ReadFile(const char *path, size_t *size);
+
+/* data of the first section tagged tag of an FGM held in memory, NULL
+ * when it has none or its section table is invalid */
+const unsigned char *FGM_FindSection(const unsigned char *fgm, size_t length, const char *tag, size_t *section_length);
+
+#endif
@@ -0,0 +1,23 @@
+/* Scene graph flattening. Meshes are placed by walking the default scene,
+ * world transforms are baked into the vertices and static instances that
+ * share a material are merged into one mesh with rebased indices */
+
+#ifndef __GLB_FLATTEN__
+#define __GLB_FLATTEN__
+
+#include <stddef.h>
+
+#include "glb.h"
+#include "gjson.h"
+
+#define FGM_SECTION_NODES "NODE"
+
+#define FGM_NODE_DYNAMIC 1 /* animated or skinned, its batches are in its local space */
+
+/* a batch stays under this many vertices when every mesh has 16-bit indices */
+#define GLB_BATCH_MAX_VERTICES 65535
+
+int GLB_Flatten(struct GLB_Meshes*, gJSON *gson, const unsigned char *bin, size_t bin_length,
+                const struct GLB_Options*);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef __GJSON_DECODER__
 #define __GJSON_DECODER__
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* data types according to JSON specifications */
 enum gJSON_type
 {
@@ -26,12 +29,82 @@ typedef struct gJSON
     int valueint;
 
     char *string; /* keys for objects */
+
+    /* lazy parsing, the text of an object or array whose children are only
+     * built when gJSON_GetObjectItem/gJSON_GetArrayItem first reaches in */
+    const unsigned char *pending;
+    size_t pending_length;
+
+    /* the children of a long array in order, built on the first lookup
+     * past the first few so that gJSON_GetArrayItem does not walk them */
+    struct gJSON **items;
+    size_t item_count;
 } gJSON;
 
 void gJSON_Delete(gJSON*);
 
 gJSON *gJSON_GetArrayItem(gJSON*, int);
 gJSON *gJSON_GetObjectItem(gJSON*, const char*);
-gJSON *gJSON_ParseWithLength(unsigned char*, size_t);
+gJSON *gJSON_ParseWithLength(const unsigned char*, size_t);
+
+/* Only the top level is built, nested objects and arrays are checked
+ * and skipped, then built on first access. Fails on the same input as
+ * gJSON_ParseWithLength. The data must outlive the tree and
+ * a tree must not be read from several threads at once */
+gJSON *gJSON_ParseLazy(const unsigned char*, size_t);
+
+size_t gJSON_CountNodes(gJSON*, size_t *allocations);
+
+/* Tape representation, the whole document in one array of 12 byte
+ * entries in document order. A container is followed by its children then
+ * an end entry, next skips over a value and everything inside it. Strings
+ * and keys point into the parsed data, raw (escapes not decoded) and not
+ * nul terminated, so the data must outlive the tape. Entry 0 is the root */
+
+#define GJSON_TAPE_END 7          /* closes a container */
+#define GJSON_TAPE_INTEGER 8      /* gJSON_Number held in value, read as gJSON_Number */
+#define GJSON_TAPE_NONE UINT32_MAX
+#define GJSON_TAPE_MAX_ENTRIES ((1u << 28) - 1)
+
+typedef struct
+{
+    uint32_t key;          /* data offset of the key of an object member, GJSON_TAPE_NONE otherwise */
+    uint32_t value;        /* data offset of a string, integer or index of a number, child count */
+    unsigned int next : 28; /* entry after this value, its next sibling or the end of its parent */
+    unsigned int type : 4;  /* gJSON_type, GJSON_TAPE_END or GJSON_TAPE_INTEGER */
+} gJSON_TapeEntry;
+
+typedef struct
+{
+    const unsigned char *data;
+    size_t length;
+
+    gJSON_TapeEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+
+    double *numbers;
+    uint32_t number_count;
+    uint32_t number_capacity;
+} gJSON_Tape;
+
+int gJSON_TapeParse(gJSON_Tape*, const unsigned char*, size_t);
+void gJSON_TapeFree(gJSON_Tape*);
+size_t gJSON_TapeSize(const gJSON_Tape*);
+
+/* GJSON_TAPE_NONE when there is no such entry. gJSON_TapeGetArrayItem
+ * steps over the items before the one asked for, one entry each whatever
+ * they contain, so walk arrays with gJSON_TapeChild and gJSON_TapeNext
+ * rather than indexing them in a loop */
+uint32_t gJSON_TapeChild(const gJSON_Tape*, uint32_t index);
+uint32_t gJSON_TapeNext(const gJSON_Tape*, uint32_t index);
+uint32_t gJSON_TapeGetArrayItem(const gJSON_Tape*, uint32_t array, int item);
+uint32_t gJSON_TapeGetObjectItem(const gJSON_Tape*, uint32_t object, const char *name);
+
+int gJSON_TapeType(const gJSON_Tape*, uint32_t index);
+double gJSON_TapeNumber(const gJSON_Tape*, uint32_t index);
+int gJSON_TapeInt(const gJSON_Tape*, uint32_t index);
+const char *gJSON_TapeString(const gJSON_Tape*, uint32_t index, size_t *length);
+const char *gJSON_TapeKey(const gJSON_Tape*, uint32_t index, size_t *length);
 
 #endif
@@ -4,8 +4,39 @@
 #ifndef __DECODER_GLB__
 #define __DECODER_GLB__
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "stats.h"
+
+#define GLB_CHUNK_JSON 0x4E4F534A
+#define GLB_CHUNK_BIN  0x004E4942
+
+/* optional outputs, each one adds a section after the mesh buffer */
+#define GLB_FLAG_SKIN (1 << 0) /* packed joints/weights and inverse bind matrices */
+#define GLB_FLAG_ANIM (1 << 1) /* animations resampled at anim_fps */
+#define GLB_FLAG_BVH  (1 << 2) /* SAH triangle BVH per mesh */
+#define GLB_FLAG_TANGENTS (1 << 3) /* TANGENT copied or generated, as a fifth stream */
+#define GLB_FLAG_FLATTEN  (1 << 4) /* world transforms baked, static meshes batched by material */
+#define GLB_FLAG_TEXTURES (1 << 5) /* embedded images copied as they are */
+#define GLB_FLAG_SHARE    (1 << 6) /* streams read from the same bytes written once */
+#define GLB_FLAG_SHARE_CONTENT (1 << 7) /* byte-identical streams written once too */
+#define GLB_FLAG_MORPH    (1 << 8) /* morph targets, sparse quantized deltas */
+
+#define GLB_FLAGS_SHARE (GLB_FLAG_SHARE | GLB_FLAG_SHARE_CONTENT)
+
+/* per-mesh stream offsets, present when streams are shared */
+#define FGM_SECTION_STREAMS "STRM"
+
+/* sections indexed by glTF mesh, meaningless once meshes are batched */
+#define GLB_FLAGS_PER_MESH (GLB_FLAG_SKIN | GLB_FLAG_BVH | GLB_FLAG_TANGENTS | GLB_FLAG_MORPH)
+
+/* per-mesh sections costly enough to be copied from a previous output for
+ * the meshes whose inputs did not change, see GLB_Previous */
+#define GLB_FLAGS_REUSED (GLB_FLAG_BVH | GLB_FLAG_TANGENTS)
+
+#define GLB_DEFAULT_ANIM_FPS 60
+
 struct BufferSizes {
     uint64_t position;
     uint64_t normals;
@@ -13,9 +44,77 @@ struct BufferSizes {
     uint64_t indices;
 };
 
-extern int buffer_position;
+/* A previous output of the same conversion, same options included. The
+ * GLB_FLAGS_REUSED sections of a mesh whose inputs hash to one of hashes
+ * are copied from it rather than built again */
+struct GLB_Previous {
+    int num_meshes;
+    const uint64_t *hashes;        /* GLB_Meshes.hashes of that conversion */
+    const unsigned char *fgm;
+    size_t length;
+};
+
+struct GLB_Options {
+    uint32_t flags;
+    struct ConvertStats *stats;    /* optional */
+    int anim_fps;                  /* 0 for GLB_DEFAULT_ANIM_FPS */
+    int threads;                   /* BVH build threads, 0 for one per processor */
+    int hash_meshes;               /* fill GLB_Meshes.hashes, not with GLB_FLAG_FLATTEN */
+    const struct GLB_Previous *previous; /* optional, needs hash_meshes */
+};
+
+/* extra data written after the mesh buffer, see the format file */
+struct GLB_Section {
+    char tag[4];
+    unsigned char *data;
+    size_t length;
+};
+
+/* Decoded meshes, buffer holds every mesh one after the other in the
+ * order of the FGM format, length is the sum of all sizes */
+struct GLB_Meshes {
+    uint16_t num_meshes;
+    struct BufferSizes *sizes;
+    unsigned char *buffer;
+    size_t length;
+
+    struct GLB_Section *sections;
+    int num_sections;
+
+    /* with GLB_Options.hash_meshes, a hash of what the per-mesh sections
+     * read from each glTF mesh : the mode and accessor values of its first
+     * primitive */
+    uint64_t *hashes;
+};
+
+/* where one mesh stream is inside the BIN chunk : length bytes from offset,
+ * or when stride is not 0 elements of element_size bytes, stride bytes
+ * apart, gathered into length bytes */
+struct GLB_Range {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t stride;
+    uint32_t element_size;
+};
+
+/* Where every stream of every mesh comes from, four ranges per mesh in
+ * FGM order. Resolved from the JSON chunk alone so the BIN chunk can be
+ * streamed */
+struct GLB_Layout {
+    uint16_t num_meshes;
+    struct BufferSizes *sizes;
+    struct GLB_Range *ranges;
+};
+
+int GLB_CheckHeader(const unsigned char *header);
+
+int GLB_DecodeLayout(struct GLB_Layout*, const unsigned char *json, size_t json_length, uint64_t bin_length,
+                     const struct GLB_Options*);
+void GLB_FreeLayout(struct GLB_Layout*);
+
+int GLB_Decode(struct GLB_Meshes*, const unsigned char *data, size_t length, const struct GLB_Options*);
+void GLB_FreeMeshes(struct GLB_Meshes*);
 
 unsigned char *GLB_GetBufferData(uint16_t *num_meshes, struct BufferSizes**, const char *);
 
 #endif
-
@@ -0,0 +1,23 @@
+/* Morph targets kept sparse, only the vertices a target moves, with their
+ * position and normal deltas quantized to int16 against per-target scales
+ * so blending touches nothing else */
+
+#ifndef __FGM_MORPH__
+#define __FGM_MORPH__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+#include "fgm.h"
+
+#define FGM_SECTION_MORPH "MRPH"
+
+/* target flags */
+#define FGM_MORPH_POSITION  (1 << 0) /* 3 int16 position deltas per vertex */
+#define FGM_MORPH_NORMAL    (1 << 1) /* 3 int16 normal deltas per vertex, after the position ones */
+#define FGM_MORPH_INDEX16   (1 << 2) /* vertex indices are uint16 rather than uint32 */
+
+int FGM_BuildMorphs(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes);
+
+#endif
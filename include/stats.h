@@ -0,0 +1,56 @@
+/* Per-stage timing and memory counters of a conversion, filled when the
+ * converter is asked for --stats. Allocations are counted when a program
+ * links src/wrap.c with ALLOC_WRAP (see the Makefile), which wraps
+ * malloc/calloc/realloc/free. The library itself needs neither, the
+ * allocation counters then stay at 0. They are process wide so concurrent
+ * conversions add up */
+
+#ifndef __FGM_STATS__
+#define __FGM_STATS__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum FGM_Stage
+{
+    FGM_STAGE_READ,      /* reading the GLB chunks */
+    FGM_STAGE_PARSE,     /* gJSON_ParseLazy, nested values are built on first access */
+    FGM_STAGE_ACCESSORS, /* resolving meshes, accessors and bufferViews */
+    FGM_STAGE_EXTRACT,   /* read_buffer and copies into the output buffer */
+    FGM_STAGE_CACHE,     /* content hashing for the conversion cache */
+    FGM_STAGE_WRITE,     /* writing the FGM file */
+    FGM_STAGE_COUNT,
+};
+
+typedef struct
+{
+    double wall;
+    double cpu;
+} StatsClock;
+
+struct ConvertStats {
+    StatsClock stages[FGM_STAGE_COUNT];
+
+    uint64_t nodes;        /* gJSON nodes of the parsed document */
+    uint64_t allocations;  /* heap allocations since FGM_StatsInit, set by FGM_StatsPrint */
+    uint64_t allocations_start;
+    uint64_t bytes_copied; /* bytes moved by memcpy while extracting */
+    uint64_t bytes_written;
+    uint64_t sections_reused; /* per-mesh section entries copied from the previous output */
+    long peak_rss_kb;
+};
+
+void FGM_StatsInit(struct ConvertStats*);
+void FGM_StatsStart(StatsClock*);
+void FGM_StatsStop(struct ConvertStats*, enum FGM_Stage, const StatsClock*);
+void FGM_StatsPrint(FILE*, struct ConvertStats*, int json);
+
+/* totals since the process started, any pointer may be NULL */
+void FGM_StatsAllocations(uint64_t *allocations, uint64_t *frees, uint64_t *bytes);
+
+/* called by the wrappers of src/wrap.c */
+void FGM_StatsCountAllocation(size_t size);
+void FGM_StatsCountFree(void);
+
+#endif
@@ -0,0 +1,24 @@
+/* Tangent frames as a fifth per-mesh stream. TANGENT is copied when the
+ * GLB has it, otherwise it is generated from the position, normal,
+ * texcoord and index data with MikkTSpace's per corner weighting. The
+ * vertices are not split, so the result is not MikkTSpace compatible on
+ * vertices shared by mirrored UVs */
+
+#ifndef __FGM_TANGENT__
+#define __FGM_TANGENT__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+#include "fgm.h"
+
+#define FGM_SECTION_TANGENTS "TANG"
+
+#define FGM_TANGENT_GENERATED 1 /* the mesh had no TANGENT attribute */
+
+/* reuse is optional, meshes it maps to a previous output are copied */
+int FGM_BuildTangents(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes,
+                      FGM_Reuse *reuse);
+
+#endif
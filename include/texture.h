@@ -0,0 +1,29 @@
+/* Embedded images copied, still encoded, into a texture section. Entries
+ * follow the glTF images array so material references stay valid, images
+ * stored outside the GLB have an empty entry */
+
+#ifndef __FGM_TEXTURE__
+#define __FGM_TEXTURE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gjson.h"
+#include "fgm.h"
+
+#define FGM_SECTION_TEXTURES "TEX "
+
+#define FGM_TEXTURE_ALIGN FGM_SECTION_ALIGN /* sections start aligned, so blobs are aligned in the file too */
+#define FGM_TEXTURE_MIME 16  /* bytes kept of the mime type, nul padded */
+
+enum FGM_TextureFormat
+{
+    FGM_TEXTURE_EXTERNAL, /* uri, nothing copied */
+    FGM_TEXTURE_PNG,
+    FGM_TEXTURE_JPEG,
+    FGM_TEXTURE_OTHER,    /* copied, dimensions unknown */
+};
+
+int FGM_BuildTextures(FGM_Bytes*, gJSON *gson, const unsigned char *bin, size_t bin_length);
+
+#endif
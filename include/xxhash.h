@@ -0,0 +1,25 @@
+/* In-tree implementation of the 64-bit xxHash (XXH64) algorithm
+ * used to fingerprint GLB inputs and extracted mesh data */
+
+#ifndef __XXHASH64__
+#define __XXHASH64__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t total_len;
+    uint64_t v[4];
+    uint64_t seed;
+    unsigned char mem[32];
+    uint32_t memsize;
+} XXH64_State;
+
+uint64_t XXH64(const void*, size_t, uint64_t);
+
+void XXH64_Init(XXH64_State*, uint64_t);
+void XXH64_Update(XXH64_State*, const void*, size_t);
+uint64_t XXH64_Digest(const XXH64_State*);
+
+#endif
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "accessor.h"
+
+static int component_size(int component_type)
+{
+    switch (component_type) {
+        case 5120: /* signed byte */
+        case 5121: /* unsigned byte */
+            return 1;
+        case 5122: /* signed short */
+        case 5123: /* unsigned short */
+            return 2;
+        case 5125: /* unsigned int */
+        case 5126: /* float */
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static int type_components(const char *type)
+{
+    if (type == NULL)
+        return 0;
+
+    if (strcmp(type, "SCALAR") == 0)
+        return 1;
+    if (strcmp(type, "VEC2") == 0)
+        return 2;
+    if (strcmp(type, "VEC3") == 0)
+        return 3;
+    if (strcmp(type, "VEC4") == 0 || strcmp(type, "MAT2") == 0)
+        return 4;
+    if (strcmp(type, "MAT3") == 0)
+        return 9;
+    if (strcmp(type, "MAT4") == 0)
+        return 16;
+
+    return 0;
+}
+
+static float read_component(const unsigned char *p, int component_type, int normalized)
+{
+    /* normalized integers follow the glTF rules, signed ones clamp at -1 */
+
+    switch (component_type) {
+        case 5120: {
+            int8_t v = (int8_t)p[0];
+            return normalized ? (v / 127.0f < -1.0f ? -1.0f : v / 127.0f) : (float)v;
+        }
+        case 5121:
+            return normalized ? p[0] / 255.0f : (float)p[0];
+        case 5122: {
+            int16_t v;
+            memcpy(&v, p, 2);
+            return normalized ? (v / 32767.0f < -1.0f ? -1.0f : v / 32767.0f) : (float)v;
+        }
+        case 5123: {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            return normalized ? v / 65535.0f : (float)v;
+        }
+        case 5125: {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return (float)v;
+        }
+        default: {
+            float v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+    }
+}
+
+static uint32_t read_uint(const unsigned char *p, int component_type)
+{
+    switch (component_type) {
+        case 5120:
+        case 5121:
+            return p[0];
+        case 5122:
+        case 5123: {
+            uint16_t v;
+            memcpy(&v, p, 2);
+            return v;
+        }
+        case 5126: {
+            float v;
+            memcpy(&v, p, 4);
+            return v > 0 ? (uint32_t)v : 0;
+        }
+        default: {
+            uint32_t v;
+            memcpy(&v, p, 4);
+            return v;
+        }
+    }
+}
+
+static int read_size(gJSON *item, uint64_t *out)
+{
+    /* byteOffset/byteLength, absent means 0. Negative, non-finite or
+     * fractional values are rejected before anything is cast */
+
+    *out = 0;
+
+    if (item == NULL)
+        return 1;
+
+    if (item->type != gJSON_Number || !(item->valuedouble >= 0.0 && item->valuedouble <= 9007199254740992.0) ||
+        item->valuedouble != floor(item->valuedouble))
+        return 0;
+
+    *out = (uint64_t)item->valuedouble;
+    return 1;
+}
+
+static int view_range(gJSON *view, uint64_t bin_length, uint64_t *offset, uint64_t *length)
+{
+    /* a bufferView must lie inside the BIN chunk */
+
+    if (view == NULL || gJSON_GetObjectItem(view, "byteLength") == NULL ||
+        !read_size(gJSON_GetObjectItem(view, "byteOffset"), offset) ||
+        !read_size(gJSON_GetObjectItem(view, "byteLength"), length))
+        return 0;
+
+    return *offset <= bin_length && *length <= bin_length - *offset;
+}
+
+int GLB_GetBufferView(gJSON *gson, int index, const unsigned char *bin, size_t bin_length,
+                      const unsigned char **data, size_t *length)
+{
+    /* bytes of bufferView index */
+
+    gJSON *view = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "bufferViews"), index);
+    uint64_t view_offset, view_length;
+
+    if (!view_range(view, bin_length, &view_offset, &view_length))
+        return 0;
+
+    *data = bin + view_offset;
+    *length = (size_t)view_length;
+
+    return 1;
+}
+
+static int get_sparse(GLB_Accessor *accessor, gJSON *gsparse, gJSON *gson, const unsigned char *bin,
+                      size_t bin_length)
+{
+    /* sparse.indices and sparse.values, both read without stride */
+
+    gJSON *gindices = gJSON_GetObjectItem(gsparse, "indices");
+    gJSON *gvalues = gJSON_GetObjectItem(gsparse, "values");
+    gJSON *item;
+    const unsigned char *data;
+    size_t length;
+    uint64_t offset;
+
+    if ((item = gJSON_GetObjectItem(gsparse, "count")) == NULL || item->valueint < 0 ||
+        gindices == NULL || gvalues == NULL)
+        return 0;
+    accessor->sparse_count = item->valueint;
+
+    if ((item = gJSON_GetObjectItem(gindices, "componentType")) == NULL)
+        return 0;
+    accessor->sparse_index_type = item->valueint;
+
+    if (accessor->sparse_index_type != 5121 && accessor->sparse_index_type != 5123 &&
+        accessor->sparse_index_type != 5125)
+        return 0;
+
+    if ((item = gJSON_GetObjectItem(gindices, "bufferView")) == NULL ||
+        !GLB_GetBufferView(gson, item->valueint, bin, bin_length, &data, &length))
+        return 0;
+
+    if (!read_size(gJSON_GetObjectItem(gindices, "byteOffset"), &offset))
+        return 0;
+
+    if (offset + (uint64_t)accessor->sparse_count*component_size(accessor->sparse_index_type) > length)
+        return 0;
+    accessor->sparse_indices = data + offset;
+
+    if ((item = gJSON_GetObjectItem(gvalues, "bufferView")) == NULL ||
+        !GLB_GetBufferView(gson, item->valueint, bin, bin_length, &data, &length))
+        return 0;
+
+    if (!read_size(gJSON_GetObjectItem(gvalues, "byteOffset"), &offset))
+        return 0;
+
+    if (offset + (uint64_t)accessor->sparse_count*accessor->component_size*accessor->components > length)
+        return 0;
+    accessor->sparse_values = data + offset;
+
+    return 1;
+}
+
+static int resolve_accessor(GLB_Accessor *accessor, gJSON *gaccessor, gJSON *gson, uint64_t bin_length,
+                            uint64_t *offset, int *has_view)
+{
+    /* everything but the sparse block and the data pointers, offset is
+     * where the first element is in the BIN chunk */
+
+    gJSON *item;
+
+    memset(accessor, 0, sizeof(GLB_Accessor));
+    *offset = 0;
+    *has_view = 0;
+
+    if (gaccessor == NULL)
+        return 0;
+
+    if ((item = gJSON_GetObjectItem(gaccessor, "count")) == NULL || item->valueint < 0)
+        return 0;
+    accessor->count = item->valueint;
+
+    if ((item = gJSON_GetObjectItem(gaccessor, "componentType")) == NULL)
+        return 0;
+    accessor->component_type = item->valueint;
+    accessor->component_size = component_size(accessor->component_type);
+
+    item = gJSON_GetObjectItem(gaccessor, "type");
+    accessor->components = type_components(item != NULL ? item->valuestring : NULL);
+
+    item = gJSON_GetObjectItem(gaccessor, "normalized");
+    accessor->normalized = item != NULL && item->type == gJSON_True;
+
+    if (accessor->component_size == 0 || accessor->components == 0)
+        return 0;
+
+    accessor->stride = (size_t)accessor->component_size*accessor->components;
+
+    /* no bufferView means all zeros (or sparse values only) */
+    if ((item = gJSON_GetObjectItem(gaccessor, "bufferView")) == NULL)
+        return 1;
+
+    gJSON *view = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "bufferViews"), item->valueint);
+    gJSON *vstride = gJSON_GetObjectItem(view, "byteStride");
+    uint64_t view_offset, view_length, accessor_offset;
+
+    if (!view_range(view, bin_length, &view_offset, &view_length) ||
+        !read_size(gJSON_GetObjectItem(gaccessor, "byteOffset"), &accessor_offset))
+        return 0;
+
+    if (vstride != NULL && vstride->valueint > 0)
+        accessor->stride = (size_t)vstride->valueint;
+
+    if (accessor->count > 0 &&
+        accessor_offset + (uint64_t)(accessor->count - 1)*accessor->stride +
+        (uint64_t)accessor->component_size*accessor->components > view_length)
+        return 0;
+
+    *offset = view_offset + accessor_offset;
+    *has_view = 1;
+
+    return 1;
+}
+
+int GLB_GetAccessor(GLB_Accessor *accessor, gJSON *gson, int index, const unsigned char *bin, size_t bin_length)
+{
+    /* resolves accessor index, checking every element lies inside the BIN chunk */
+
+    gJSON *gaccessor = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "accessors"), index);
+    gJSON *gsparse = gJSON_GetObjectItem(gaccessor, "sparse");
+    uint64_t offset;
+    int has_view;
+
+    if (!resolve_accessor(accessor, gaccessor, gson, bin_length, &offset, &has_view))
+        return 0;
+
+    if (gsparse != NULL && !get_sparse(accessor, gsparse, gson, bin, bin_length))
+        return 0;
+
+    accessor->data = has_view ? bin + offset : NULL;
+
+    return 1;
+}
+
+int GLB_GetAccessorRange(GLB_Accessor *accessor, gJSON *gson, int index, uint64_t bin_length, uint64_t *offset)
+{
+    /* where the elements of accessor index are in the BIN chunk, from the
+     * JSON chunk alone. Only accessors whose bytes hold their values, with
+     * a bufferView and without a sparse block, have one */
+
+    gJSON *gaccessor = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "accessors"), index);
+    int has_view;
+
+    return resolve_accessor(accessor, gaccessor, gson, bin_length, offset, &has_view) && has_view &&
+           gJSON_GetObjectItem(gaccessor, "sparse") == NULL;
+}
+
+static uint32_t sparse_index(const GLB_Accessor *accessor, int i)
+{
+    return read_uint(accessor->sparse_indices + (size_t)i*component_size(accessor->sparse_index_type),
+                     accessor->sparse_index_type);
+}
+
+static const unsigned char *sparse_element(const GLB_Accessor *accessor, int i)
+{
+    return accessor->sparse_values + (size_t)i*accessor->component_size*accessor->components;
+}
+
+float *GLB_ReadFloats(const GLB_Accessor *accessor, int components)
+{
+    /* count*components floats, missing components are 0 and extra ones dropped */
+
+    float *out = calloc((size_t)(accessor->count > 0 ? accessor->count : 1)*components, sizeof(float));
+    int n = accessor->components < components ? accessor->components : components;
+
+    if (out == NULL)
+        return NULL;
+
+    for (int i = 0; accessor->data != NULL && i < accessor->count; i++) {
+        const unsigned char *element = accessor->data + (size_t)i*accessor->stride;
+
+        for (int j = 0; j < n; j++)
+            out[(size_t)i*components + j] = read_component(element + j*accessor->component_size,
+                                                           accessor->component_type, accessor->normalized);
+    }
+
+    for (int i = 0; i < accessor->sparse_count; i++) {
+        uint32_t index = sparse_index(accessor, i);
+        const unsigned char *element = sparse_element(accessor, i);
+
+        for (int j = 0; index < (uint32_t)accessor->count && j < n; j++)
+            out[(size_t)index*components + j] = read_component(element + j*accessor->component_size,
+                                                               accessor->component_type, accessor->normalized);
+    }
+
+    return out;
+}
+
+uint32_t *GLB_ReadUints(const GLB_Accessor *accessor, int components)
+{
+    uint32_t *out = calloc((size_t)(accessor->count > 0 ? accessor->count : 1)*components, sizeof(uint32_t));
+    int n = accessor->components < components ? accessor->components : components;
+
+    if (out == NULL)
+        return NULL;
+
+    for (int i = 0; accessor->data != NULL && i < accessor->count; i++) {
+        const unsigned char *element = accessor->data + (size_t)i*accessor->stride;
+
+        for (int j = 0; j < n; j++)
+            out[(size_t)i*components + j] = read_uint(element + j*accessor->component_size, accessor->component_type);
+    }
+
+    for (int i = 0; i < accessor->sparse_count; i++) {
+        uint32_t index = sparse_index(accessor, i);
+        const unsigned char *element = sparse_element(accessor, i);
+
+        for (int j = 0; index < (uint32_t)accessor->count && j < n; j++)
+            out[(size_t)index*components + j] = read_uint(element + j*accessor->component_size,
+                                                          accessor->component_type);
+    }
+
+    return out;
+}
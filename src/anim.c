@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "anim.h"
+#include "accessor.h"
+
+enum
+{
+    INTERP_LINEAR,
+    INTERP_STEP,
+    INTERP_CUBICSPLINE,
+};
+
+/* a channel loaded for resampling */
+typedef struct
+{
+    int node;
+    int path;
+    int components;
+    int interpolation;
+    int key_count;
+    float *times;
+    float *values; /* 3 values per key for CUBICSPLINE, in-tangent, value, out-tangent */
+} Channel;
+
+static int count_items(gJSON *array)
+{
+    int count = 0;
+
+    for (gJSON *item = gJSON_GetArrayItem(array, 0); item != NULL; item = item->next)
+        count++;
+
+    return count;
+}
+
+static int get_int(gJSON *object, const char *name, int fallback)
+{
+    gJSON *item = gJSON_GetObjectItem(object, name);
+    return item != NULL ? item->valueint : fallback;
+}
+
+static void pack_weights(const float weights[4], unsigned char packed[4])
+{
+    /* unorm8 weights summing to exactly 255, the rounding error goes to
+     * the weights that lost the most */
+
+    float sum = weights[0] + weights[1] + weights[2] + weights[3];
+    float remainder[4];
+    int total = 0;
+
+    if (sum <= 0.0f) {
+        packed[0] = 255;
+        packed[1] = packed[2] = packed[3] = 0;
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        float scaled = (weights[i] > 0.0f ? weights[i] : 0.0f) / sum * 255.0f;
+
+        packed[i] = (unsigned char)scaled;
+        remainder[i] = scaled - packed[i];
+        total += packed[i];
+    }
+
+    while (total < 255) {
+        int best = 0;
+
+        for (int i = 1; i < 4; i++) {
+            if (remainder[i] > remainder[best])
+                best = i;
+        }
+
+        packed[best]++;
+        remainder[best] = -1.0f;
+        total++;
+    }
+}
+
+static int build_skin_stream(FGM_Bytes *bytes, gJSON *gattr, gJSON *gson, const unsigned char *bin,
+                             size_t bin_length, uint32_t *vertex_count, uint64_t *offset)
+{
+    /* 8 bytes per vertex, joints then weights */
+
+    GLB_Accessor joints_accessor, weights_accessor;
+    gJSON *gjoints = gJSON_GetObjectItem(gattr, "JOINTS_0");
+    gJSON *gweights = gJSON_GetObjectItem(gattr, "WEIGHTS_0");
+
+    *vertex_count = 0;
+    *offset = 0;
+
+    if (gjoints == NULL || gweights == NULL)
+        return 1;
+
+    if (!GLB_GetAccessor(&joints_accessor, gson, gjoints->valueint, bin, bin_length) ||
+        !GLB_GetAccessor(&weights_accessor, gson, gweights->valueint, bin, bin_length) ||
+        joints_accessor.count != weights_accessor.count)
+        return 0;
+
+    uint32_t *joints = GLB_ReadUints(&joints_accessor, 4);
+    float *weights = GLB_ReadFloats(&weights_accessor, 4);
+    int status = joints != NULL && weights != NULL;
+
+    if (status) {
+        FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+        *offset = FGM_BytesAppend(bytes, NULL, (size_t)joints_accessor.count*8);
+        *vertex_count = (uint32_t)joints_accessor.count;
+    }
+
+    for (int i = 0; status && !bytes->failed && i < joints_accessor.count; i++) {
+        unsigned char *packed = bytes->data + *offset + (size_t)i*8;
+
+        for (int j = 0; j < 4; j++) {
+            /* an unused slot may point anywhere, only weighted joints must fit */
+            if (joints[i*4 + j] > 255 && weights[i*4 + j] > 0.0f) {
+                fprintf(stderr, "FGM_BuildSkins : Error, joint %u does not fit in 8 bits\n", joints[i*4 + j]);
+                status = 0;
+            }
+            packed[j] = joints[i*4 + j] > 255 ? 0 : (unsigned char)joints[i*4 + j];
+        }
+
+        pack_weights(weights + i*4, packed + 4);
+    }
+
+    free(joints);
+    free(weights);
+
+    return status;
+}
+
+int FGM_BuildSkins(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes)
+{
+    gJSON *gskins = gJSON_GetObjectItem(gson, "skins");
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    int skin_count = count_items(gskins);
+    int status = 1;
+
+    /* the skin of a mesh comes from the first node using both */
+    int *mesh_skin = malloc(sizeof(int)*(num_meshes > 0 ? num_meshes : 1));
+    if (mesh_skin == NULL)
+        return 0;
+
+    for (int i = 0; i < num_meshes; i++)
+        mesh_skin[i] = -1;
+
+    for (gJSON *node = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "nodes"), 0); node != NULL; node = node->next) {
+        int mesh = get_int(node, "mesh", -1);
+        int skin = get_int(node, "skin", -1);
+
+        if (mesh >= 0 && mesh < num_meshes && skin >= 0 && skin < skin_count && mesh_skin[mesh] < 0)
+            mesh_skin[mesh] = skin;
+    }
+
+    /* header then the skin and mesh tables, filled in as data is appended */
+    uint32_t header[4] = { (uint32_t)skin_count, (uint32_t)num_meshes, 16, 16 + 16*(uint32_t)skin_count };
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 16*(size_t)skin_count + 16*(size_t)num_meshes);
+
+    gJSON *gskin = gJSON_GetArrayItem(gskins, 0);
+
+    for (int s = 0; status && gskin != NULL; s++, gskin = gskin->next) {
+        gJSON *gjoints = gJSON_GetObjectItem(gskin, "joints");
+        gJSON *gibm = gJSON_GetObjectItem(gskin, "inverseBindMatrices");
+        int joint_count = count_items(gjoints);
+        float *matrices = NULL;
+
+        if (gibm != NULL) {
+            GLB_Accessor accessor;
+
+            if (!GLB_GetAccessor(&accessor, gson, gibm->valueint, bin, bin_length) ||
+                accessor.count < joint_count) {
+                fprintf(stderr, "FGM_BuildSkins : Error, skin %d has invalid inverseBindMatrices\n", s);
+                status = 0;
+                break;
+            }
+
+            matrices = GLB_ReadFloats(&accessor, 16);
+        }
+
+        FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+        uint32_t joints_offset = (uint32_t)bytes->length;
+
+        for (gJSON *joint = gJSON_GetArrayItem(gjoints, 0); joint != NULL; joint = joint->next) {
+            int32_t node = joint->valueint;
+            FGM_BytesAppend(bytes, &node, sizeof(int32_t));
+        }
+
+        /* identity when the skin has none */
+        FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+        uint32_t matrices_offset = (uint32_t)bytes->length;
+
+        for (int j = 0; j < joint_count; j++) {
+            float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+            FGM_BytesAppend(bytes, matrices != NULL ? matrices + j*16 : identity, sizeof(identity));
+        }
+
+        free(matrices);
+
+        int32_t entry[4] = { joint_count, (int32_t)joints_offset, (int32_t)matrices_offset,
+                             get_int(gskin, "skeleton", -1) };
+        FGM_BytesPatch(bytes, 16 + 16*(size_t)s, entry, sizeof(entry));
+    }
+
+    for (int m = 0; status && m < num_meshes; m++) {
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(gmeshes, m), "primitives"), 0);
+        uint32_t vertex_count;
+        uint64_t offset;
+
+        if (!build_skin_stream(bytes, gJSON_GetObjectItem(gprim, "attributes"), gson, bin, bin_length,
+                               &vertex_count, &offset)) {
+            fprintf(stderr, "FGM_BuildSkins : Error, mesh %d has invalid JOINTS_0/WEIGHTS_0\n", m);
+            status = 0;
+            break;
+        }
+
+        unsigned char entry[16];
+        int32_t skin = vertex_count > 0 ? mesh_skin[m] : -1;
+
+        memcpy(entry, &skin, 4);
+        memcpy(entry + 4, &vertex_count, 4);
+        memcpy(entry + 8, &offset, 8);
+        FGM_BytesPatch(bytes, 16 + 16*(size_t)skin_count + 16*(size_t)m, entry, sizeof(entry));
+    }
+
+    free(mesh_skin);
+
+    return status && !bytes->failed;
+}
+
+static void normalize_quat(float *q)
+{
+    float length = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+
+    if (length > 0.0f) {
+        for (int i = 0; i < 4; i++)
+            q[i] /= length;
+    }
+}
+
+static void slerp(const float *a, const float *b, float t, float *out)
+{
+    float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+    float sign = d < 0.0f ? -1.0f : 1.0f;
+    float wa, wb;
+
+    d *= sign;
+
+    /* close quaternions fall back to a normalized lerp */
+    if (d > 0.9995f) {
+        wa = 1.0f - t;
+        wb = t;
+    } else {
+        float theta = acosf(d);
+        float s = sinf(theta);
+
+        wa = sinf((1.0f - t)*theta) / s;
+        wb = sinf(t*theta) / s;
+    }
+
+    for (int i = 0; i < 4; i++)
+        out[i] = wa*a[i] + wb*sign*b[i];
+
+    normalize_quat(out);
+}
+
+static void sample_channel(const Channel *channel, float t, float *out)
+{
+    /* glTF sampling rules, clamped outside of the keyframes */
+
+    int n = channel->components;
+    int stride = channel->interpolation == INTERP_CUBICSPLINE ? 3*n : n;
+    int value = channel->interpolation == INTERP_CUBICSPLINE ? n : 0;
+    int last = channel->key_count - 1;
+    const float *times = channel->times;
+
+    if (t <= times[0] || last == 0) {
+        memcpy(out, channel->values + value, sizeof(float)*n);
+        return;
+    }
+
+    if (t >= times[last]) {
+        memcpy(out, channel->values + (size_t)last*stride + value, sizeof(float)*n);
+        return;
+    }
+
+    /* last key at or before t */
+    int lo = 0, hi = last;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+
+        if (times[mid] <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    float dt = times[hi] - times[lo];
+    float u = dt > 0.0f ? (t - times[lo]) / dt : 0.0f;
+    const float *k0 = channel->values + (size_t)lo*stride;
+    const float *k1 = channel->values + (size_t)hi*stride;
+
+    switch (channel->interpolation) {
+        case INTERP_STEP:
+            memcpy(out, k0, sizeof(float)*n);
+            return;
+
+        case INTERP_CUBICSPLINE: {
+            float u2 = u*u, u3 = u2*u;
+            float h00 = 2*u3 - 3*u2 + 1, h10 = u3 - 2*u2 + u, h01 = -2*u3 + 3*u2, h11 = u3 - u2;
+
+            for (int i = 0; i < n; i++)
+                out[i] = h00*k0[n + i] + h10*dt*k0[2*n + i] + h01*k1[n + i] + h11*dt*k1[i];
+
+            if (channel->path == FGM_PATH_ROTATION)
+                normalize_quat(out);
+            return;
+        }
+
+        default:
+            if (channel->path == FGM_PATH_ROTATION) {
+                slerp(k0, k1, u, out);
+                return;
+            }
+
+            for (int i = 0; i < n; i++)
+                out[i] = k0[i] + (k1[i] - k0[i])*u;
+            return;
+    }
+}
+
+static int load_channel(Channel *channel, gJSON *gchannel, gJSON *gsamplers, gJSON *gson,
+                        const unsigned char *bin, size_t bin_length)
+{
+    /* returns 1 when loaded, 0 when the channel is skipped and -1 on error */
+
+    gJSON *target = gJSON_GetObjectItem(gchannel, "target");
+    gJSON *gpath = gJSON_GetObjectItem(target, "path");
+    gJSON *sampler = gJSON_GetArrayItem(gsamplers, get_int(gchannel, "sampler", -1));
+    gJSON *ginterp = gJSON_GetObjectItem(sampler, "interpolation");
+    GLB_Accessor input, output;
+
+    memset(channel, 0, sizeof(Channel));
+    channel->node = get_int(target, "node", -1);
+
+    /* morph target weights are not part of these tracks */
+    if (channel->node < 0 || gpath == NULL || gpath->valuestring == NULL || sampler == NULL)
+        return 0;
+
+    if (strcmp(gpath->valuestring, "translation") == 0) {
+        channel->path = FGM_PATH_TRANSLATION;
+        channel->components = 3;
+    } else if (strcmp(gpath->valuestring, "rotation") == 0) {
+        channel->path = FGM_PATH_ROTATION;
+        channel->components = 4;
+    } else if (strcmp(gpath->valuestring, "scale") == 0) {
+        channel->path = FGM_PATH_SCALE;
+        channel->components = 3;
+    } else {
+        return 0;
+    }
+
+    channel->interpolation = INTERP_LINEAR;
+    if (ginterp != NULL && ginterp->valuestring != NULL) {
+        if (strcmp(ginterp->valuestring, "STEP") == 0)
+            channel->interpolation = INTERP_STEP;
+        else if (strcmp(ginterp->valuestring, "CUBICSPLINE") == 0)
+            channel->interpolation = INTERP_CUBICSPLINE;
+    }
+
+    if (!GLB_GetAccessor(&input, gson, get_int(sampler, "input", -1), bin, bin_length) ||
+        !GLB_GetAccessor(&output, gson, get_int(sampler, "output", -1), bin, bin_length) ||
+        input.count == 0)
+        return -1;
+
+    int per_key = channel->interpolation == INTERP_CUBICSPLINE ? 3 : 1;
+    if (output.count < input.count*per_key)
+        return -1;
+
+    channel->key_count = input.count;
+    channel->times = GLB_ReadFloats(&input, 1);
+    channel->values = GLB_ReadFloats(&output, channel->components);
+
+    if (channel->times == NULL || channel->values == NULL)
+        return -1;
+
+    /* times in seconds from 0, a NaN or infinite one has no frame */
+    for (int k = 0; k < channel->key_count; k++) {
+        if (!isfinite(channel->times[k]) || channel->times[k] < 0.0f)
+            return -1;
+    }
+
+    return 1;
+}
+
+static void write_track(FGM_Bytes *bytes, size_t entry_offset, const Channel *channel, int fps, int frame_count,
+                        float *samples)
+{
+    /* samples every frame, then stores each component as uint16 with a
+     * per-component bias and scale: value = bias + scale*key */
+
+    int n = channel->components;
+    float bias[4] = { 0, 0, 0, 0 }, scale[4] = { 0, 0, 0, 0 };
+    uint32_t flags = FGM_TRACK_CONSTANT;
+    float end = channel->times[channel->key_count - 1];
+
+    for (int f = 0; f < frame_count; f++) {
+        float t = (float)f / (float)fps;
+        sample_channel(channel, t < end ? t : end, samples + (size_t)f*n);
+    }
+
+    for (int i = 0; i < n; i++) {
+        float lo = samples[i], hi = samples[i];
+
+        for (int f = 1; f < frame_count; f++) {
+            float v = samples[(size_t)f*n + i];
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+
+        bias[i] = lo;
+        scale[i] = (hi - lo) / 65535.0f;
+
+        if (hi > lo)
+            flags = 0;
+    }
+
+    int stored = flags & FGM_TRACK_CONSTANT ? 1 : frame_count;
+
+    FGM_BytesAlign(bytes, 4);
+    size_t keys_offset = FGM_BytesAppend(bytes, NULL, sizeof(uint16_t)*n*(size_t)stored);
+
+    for (int f = 0; !bytes->failed && f < stored; f++) {
+        for (int i = 0; i < n; i++) {
+            float q = scale[i] > 0.0f ? (samples[(size_t)f*n + i] - bias[i]) / scale[i] + 0.5f : 0.0f;
+            uint16_t key = q >= 65535.0f ? 65535 : (uint16_t)q;
+
+            memcpy(bytes->data + keys_offset + ((size_t)f*n + i)*sizeof(uint16_t), &key, sizeof(uint16_t));
+        }
+    }
+
+    /* int32 node, uint16 path, uint16 components, uint32 flags, uint32 keys, float bias[4], float scale[4] */
+    unsigned char entry[48];
+    int32_t node = channel->node;
+    uint16_t path = (uint16_t)channel->path, components = (uint16_t)n;
+    uint32_t keys = (uint32_t)keys_offset;
+
+    memcpy(entry, &node, 4);
+    memcpy(entry + 4, &path, 2);
+    memcpy(entry + 6, &components, 2);
+    memcpy(entry + 8, &flags, 4);
+    memcpy(entry + 12, &keys, 4);
+    memcpy(entry + 16, bias, 16);
+    memcpy(entry + 32, scale, 16);
+    FGM_BytesPatch(bytes, entry_offset, entry, sizeof(entry));
+}
+
+static int add_animation(FGM_Bytes *bytes, gJSON *ganimation, int a, gJSON *gson, const unsigned char *bin,
+                         size_t bin_length, int fps)
+{
+    /* appends the tracks of animation a and fills its entry */
+
+    gJSON *gchannels = gJSON_GetObjectItem(ganimation, "channels");
+    gJSON *gsamplers = gJSON_GetObjectItem(ganimation, "samplers");
+    int channel_count = count_items(gchannels);
+    int track_count = 0, frame_count;
+    float duration = 0.0f, *samples = NULL;
+    int status = 0;
+
+    Channel *channels = calloc(channel_count > 0 ? channel_count : 1, sizeof(Channel));
+    if (channels == NULL)
+        goto end;
+
+    for (gJSON *gchannel = gJSON_GetArrayItem(gchannels, 0); gchannel != NULL; gchannel = gchannel->next) {
+        int loaded = load_channel(&channels[track_count], gchannel, gsamplers, gson, bin, bin_length);
+
+        if (loaded < 0) {
+            fprintf(stderr, "FGM_BuildAnimations : Error, animation %d has an invalid channel\n", a);
+            free(channels[track_count].times);
+            free(channels[track_count].values);
+            goto end;
+        }
+
+        if (loaded > 0) {
+            Channel *c = &channels[track_count++];
+
+            if (c->times[c->key_count - 1] > duration)
+                duration = c->times[c->key_count - 1];
+        }
+    }
+
+    if (duration*(float)fps >= (float)FGM_ANIM_MAX_FRAMES) {
+        fprintf(stderr, "FGM_BuildAnimations : Error, animation %d lasts %g s, more than %d frames at %d fps\n",
+                a, duration, FGM_ANIM_MAX_FRAMES, fps);
+        goto end;
+    }
+
+    /* frame f is at f/fps, the last one lands on or just after the end */
+    frame_count = (int)ceilf(duration*fps - 1e-4f) + 1;
+    samples = malloc(sizeof(float)*4*(size_t)frame_count);
+    if (samples == NULL)
+        goto end;
+
+    FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+    size_t tracks_offset = FGM_BytesAppend(bytes, NULL, 48*(size_t)track_count);
+
+    for (int t = 0; t < track_count; t++)
+        write_track(bytes, tracks_offset + 48*(size_t)t, &channels[t], fps, frame_count, samples);
+
+    unsigned char entry[16];
+    uint32_t values[3] = { (uint32_t)frame_count, (uint32_t)track_count, (uint32_t)tracks_offset };
+
+    memcpy(entry, values, 12);
+    memcpy(entry + 12, &duration, 4);
+    FGM_BytesPatch(bytes, 16 + 16*(size_t)a, entry, sizeof(entry));
+    status = 1;
+
+end:
+    for (int t = 0; channels != NULL && t < track_count; t++) {
+        free(channels[t].times);
+        free(channels[t].values);
+    }
+    free(channels);
+    free(samples);
+
+    return status;
+}
+
+int FGM_BuildAnimations(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length, int fps)
+{
+    gJSON *ganimations = gJSON_GetObjectItem(gson, "animations");
+    int animation_count = count_items(ganimations);
+    int status = 1;
+
+    if (fps <= 0)
+        fps = 60;
+
+    uint32_t header[4] = { (uint32_t)animation_count, (uint32_t)fps, 16, 0 };
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 16*(size_t)animation_count);
+
+    gJSON *ganimation = gJSON_GetArrayItem(ganimations, 0);
+
+    for (int a = 0; status && ganimation != NULL; a++, ganimation = ganimation->next)
+        status = add_animation(bytes, ganimation, a, gson, bin, bin_length, fps);
+
+    return status && !bytes->failed;
+}
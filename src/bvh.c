@@ -0,0 +1,500 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "bvh.h"
+#include "accessor.h"
+
+#define MAX_DEPTH 64            /* deeper nodes are split in half to bound the recursion */
+#define PARALLEL_SUBTREE 4096   /* smallest subtree handed to another thread */
+
+typedef struct
+{
+    FGM_BVHNode *data;
+    size_t count;
+    size_t capacity;
+    int failed;
+} NodeList;
+
+typedef struct
+{
+    /* 3 floats per triangle each, indexed by triangle */
+    float *tri_min;
+    float *tri_max;
+    float *centroid;
+
+    uint32_t *order; /* triangles in leaf order, threads only touch their own range */
+} Builder;
+
+typedef struct
+{
+    Builder *builder;
+    NodeList nodes;
+    uint32_t first;
+    uint32_t count;
+    int depth;
+    int spawn;
+} Task;
+
+static void build_node(Builder*, NodeList*, uint32_t first, uint32_t count, int depth, int spawn);
+
+static size_t push_node(NodeList *nodes)
+{
+    if (nodes->count == nodes->capacity) {
+        size_t capacity = nodes->capacity > 0 ? nodes->capacity*2 : 64;
+        FGM_BVHNode *data = realloc(nodes->data, sizeof(FGM_BVHNode)*capacity);
+
+        if (data == NULL) {
+            nodes->failed = 1;
+            return 0;
+        }
+
+        nodes->data = data;
+        nodes->capacity = capacity;
+    }
+
+    return nodes->count++;
+}
+
+static void append_nodes(NodeList *nodes, const NodeList *subtree, uint32_t base)
+{
+    /* subtree indices are local, interior nodes are moved to base */
+
+    for (size_t i = 0; !nodes->failed && i < subtree->count; i++) {
+        size_t index = push_node(nodes);
+
+        if (nodes->failed)
+            return;
+
+        nodes->data[index] = subtree->data[i];
+        if (subtree->data[i].count == 0)
+            nodes->data[index].right_or_first += base;
+    }
+}
+
+static float half_area(const float *min, const float *max)
+{
+    float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+static void grow(float *min, float *max, const float *bmin, const float *bmax)
+{
+    for (int i = 0; i < 3; i++) {
+        min[i] = bmin[i] < min[i] ? bmin[i] : min[i];
+        max[i] = bmax[i] > max[i] ? bmax[i] : max[i];
+    }
+}
+
+static int bin_index(float centroid, float min, float scale)
+{
+    /* clamped before the cast, which is undefined past the int range */
+    float b = (centroid - min)*scale;
+
+    return b > 0.0f ? (b < FGM_BVH_BINS ? (int)b : FGM_BVH_BINS - 1) : 0;
+}
+
+static int find_split(const Builder *builder, uint32_t first, uint32_t count, const float *cmin,
+                      const float *cmax, float *best_cost, int *best_bin)
+{
+    /* binned SAH over the three axes, returns the axis or -1 */
+
+    int best_axis = -1;
+
+    *best_cost = FLT_MAX;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = cmax[axis] - cmin[axis];
+
+        if (!(extent > 0.0f))
+            continue;
+
+        float scale = FGM_BVH_BINS / extent;
+        float bin_min[FGM_BVH_BINS][3], bin_max[FGM_BVH_BINS][3];
+        uint32_t bin_count[FGM_BVH_BINS] = { 0 };
+
+        for (int b = 0; b < FGM_BVH_BINS; b++) {
+            bin_min[b][0] = bin_min[b][1] = bin_min[b][2] = FLT_MAX;
+            bin_max[b][0] = bin_max[b][1] = bin_max[b][2] = -FLT_MAX;
+        }
+
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t tri = builder->order[i];
+            int b = bin_index(builder->centroid[tri*3 + axis], cmin[axis], scale);
+            bin_count[b]++;
+            grow(bin_min[b], bin_max[b], builder->tri_min + tri*3, builder->tri_max + tri*3);
+        }
+
+        /* cost of the left side of every plane, then swept from the right */
+        float left_cost[FGM_BVH_BINS - 1];
+        float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        uint32_t n = 0;
+
+        for (int b = 0; b < FGM_BVH_BINS - 1; b++) {
+            n += bin_count[b];
+            if (bin_count[b] > 0)
+                grow(min, max, bin_min[b], bin_max[b]);
+            left_cost[b] = n > 0 ? half_area(min, max)*n : 0.0f;
+        }
+
+        min[0] = min[1] = min[2] = FLT_MAX;
+        max[0] = max[1] = max[2] = -FLT_MAX;
+        n = 0;
+
+        for (int b = FGM_BVH_BINS - 1; b > 0; b--) {
+            n += bin_count[b];
+            if (bin_count[b] > 0)
+                grow(min, max, bin_min[b], bin_max[b]);
+
+            float cost = left_cost[b - 1] + (n > 0 ? half_area(min, max)*n : 0.0f);
+
+            if (n > 0 && n < count && cost < *best_cost) {
+                *best_cost = cost;
+                *best_bin = b - 1;
+                best_axis = axis;
+            }
+        }
+    }
+
+    return best_axis;
+}
+
+static void *run_task(void *arg)
+{
+    Task *task = arg;
+
+    build_node(task->builder, &task->nodes, task->first, task->count, task->depth, task->spawn);
+
+    return NULL;
+}
+
+static void build_children(Builder *builder, NodeList *nodes, size_t index, uint32_t first, uint32_t count,
+                           uint32_t mid, int depth, int spawn)
+{
+    uint32_t left_count = mid - first;
+
+    if (spawn > 0 && left_count >= PARALLEL_SUBTREE && count - left_count >= PARALLEL_SUBTREE) {
+        /* the left subtree on a new thread, the right one here, both are
+         * then copied after their parent */
+
+        Task tasks[2] = {
+            { builder, { NULL, 0, 0, 0 }, first, left_count, depth + 1, spawn - 1 },
+            { builder, { NULL, 0, 0, 0 }, mid, count - left_count, depth + 1, spawn - 1 },
+        };
+        pthread_t thread;
+        int threaded = pthread_create(&thread, NULL, run_task, &tasks[0]) == 0;
+
+        if (!threaded)
+            run_task(&tasks[0]);
+
+        run_task(&tasks[1]);
+
+        if (threaded)
+            pthread_join(thread, NULL);
+
+        uint32_t right = (uint32_t)(index + 1 + tasks[0].nodes.count);
+
+        nodes->failed |= tasks[0].nodes.failed | tasks[1].nodes.failed;
+        append_nodes(nodes, &tasks[0].nodes, (uint32_t)index + 1);
+        append_nodes(nodes, &tasks[1].nodes, right);
+        nodes->data[index].right_or_first = right;
+
+        free(tasks[0].nodes.data);
+        free(tasks[1].nodes.data);
+        return;
+    }
+
+    build_node(builder, nodes, first, left_count, depth + 1, spawn);
+    if (nodes->failed)
+        return;
+
+    nodes->data[index].right_or_first = (uint32_t)nodes->count;
+    build_node(builder, nodes, mid, count - left_count, depth + 1, spawn);
+}
+
+static void build_node(Builder *builder, NodeList *nodes, uint32_t first, uint32_t count, int depth, int spawn)
+{
+    size_t index = push_node(nodes);
+    FGM_BVHNode node;
+    float cmin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    if (nodes->failed)
+        return;
+
+    node.min[0] = node.min[1] = node.min[2] = FLT_MAX;
+    node.max[0] = node.max[1] = node.max[2] = -FLT_MAX;
+    node.right_or_first = first;
+    node.count = count;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t tri = builder->order[i];
+
+        grow(node.min, node.max, builder->tri_min + tri*3, builder->tri_max + tri*3);
+        grow(cmin, cmax, builder->centroid + tri*3, builder->centroid + tri*3);
+    }
+
+    nodes->data[index] = node;
+
+    if (count <= 2)
+        return;
+
+    /* a split has to beat intersecting every triangle of the node, the
+     * cost of visiting the node itself counts as one triangle */
+    float area = half_area(node.min, node.max);
+    float cost = FLT_MAX;
+    int bin = 0;
+    int axis = depth < MAX_DEPTH ? find_split(builder, first, count, cmin, cmax, &cost, &bin) : -1;
+    uint32_t mid = first;
+
+    if (axis >= 0 && (area + cost < area*count || count > FGM_BVH_LEAF_SIZE)) {
+        float scale = FGM_BVH_BINS / (cmax[axis] - cmin[axis]);
+        uint32_t end = first + count;
+
+        while (mid < end) {
+            uint32_t tri = builder->order[mid];
+            int b = bin_index(builder->centroid[tri*3 + axis], cmin[axis], scale);
+
+            if (b <= bin) {
+                mid++;
+            } else {
+                builder->order[mid] = builder->order[--end];
+                builder->order[end] = tri;
+            }
+        }
+    } else if (count > FGM_BVH_LEAF_SIZE) {
+        /* every centroid in the same place or too deep, halves keep the
+         * leaves small even if they overlap */
+        mid = first + count/2;
+    }
+
+    if (mid == first || mid == first + count)
+        return;
+
+    nodes->data[index].count = 0;
+    build_children(builder, nodes, index, first, count, mid, depth, spawn);
+}
+
+static int load_triangles(Builder *builder, uint32_t **triangles, uint32_t *triangle_count, gJSON *gprim,
+                          gJSON *gson, const unsigned char *bin, size_t bin_length)
+{
+    /* triangle bounds and vertex indices of a primitive, 1 with no
+     * triangles for other modes */
+
+    GLB_Accessor positions, indices;
+    gJSON *gmode = gJSON_GetObjectItem(gprim, "mode");
+    gJSON *gposition = gJSON_GetObjectItem(gJSON_GetObjectItem(gprim, "attributes"), "POSITION");
+    gJSON *gindices = gJSON_GetObjectItem(gprim, "indices");
+    uint32_t *vertices = NULL;
+    float *points = NULL;
+    int status = 0;
+
+    *triangles = NULL;
+    *triangle_count = 0;
+
+    if ((gmode != NULL && gmode->valueint != 4) || gposition == NULL)
+        return 1;
+
+    if (!GLB_GetAccessor(&positions, gson, gposition->valueint, bin, bin_length))
+        return 0;
+
+    points = GLB_ReadFloats(&positions, 3);
+    if (points == NULL)
+        goto end;
+
+    for (int i = 0; i < positions.count*3; i++) {
+        if (!isfinite(points[i])) {
+            fprintf(stderr, "FGM_BuildBVH : Error, vertex %d has a NaN or infinite position\n", i/3);
+            goto end;
+        }
+    }
+
+    if (gindices != NULL) {
+        if (!GLB_GetAccessor(&indices, gson, gindices->valueint, bin, bin_length))
+            goto end;
+
+        vertices = GLB_ReadUints(&indices, 1);
+        *triangle_count = (uint32_t)(indices.count / 3);
+    } else {
+        vertices = malloc(sizeof(uint32_t)*(positions.count > 0 ? positions.count : 1));
+        for (int i = 0; vertices != NULL && i < positions.count; i++)
+            vertices[i] = (uint32_t)i;
+        *triangle_count = (uint32_t)(positions.count / 3);
+    }
+
+    if (vertices == NULL)
+        goto end;
+
+    size_t n = *triangle_count > 0 ? *triangle_count : 1;
+
+    builder->tri_min = malloc(sizeof(float)*3*n);
+    builder->tri_max = malloc(sizeof(float)*3*n);
+    builder->centroid = malloc(sizeof(float)*3*n);
+    builder->order = malloc(sizeof(uint32_t)*n);
+
+    if (builder->tri_min == NULL || builder->tri_max == NULL || builder->centroid == NULL || builder->order == NULL)
+        goto end;
+
+    for (uint32_t t = 0; t < *triangle_count; t++) {
+        float *min = builder->tri_min + t*3, *max = builder->tri_max + t*3;
+
+        min[0] = min[1] = min[2] = FLT_MAX;
+        max[0] = max[1] = max[2] = -FLT_MAX;
+
+        for (int v = 0; v < 3; v++) {
+            uint32_t vertex = vertices[t*3 + v];
+
+            if (vertex >= (uint32_t)positions.count) {
+                fprintf(stderr, "FGM_BuildBVH : Error, index %u out of %d vertices\n", vertex, positions.count);
+                goto end;
+            }
+
+            grow(min, max, points + vertex*3, points + vertex*3);
+        }
+
+        for (int i = 0; i < 3; i++)
+            builder->centroid[t*3 + i] = min[i]*0.5f + max[i]*0.5f; /* no overflow near FLT_MAX */
+
+        builder->order[t] = t;
+    }
+
+    *triangles = vertices;
+    vertices = NULL;
+    status = 1;
+
+end:
+    free(points);
+    free(vertices);
+
+    return status;
+}
+
+static int cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+static int copy_mesh(FGM_Bytes *bytes, FGM_Reuse *reuse, int m, unsigned char entry[32])
+{
+    /* appends the nodes and triangles of mesh m from the previous output and
+     * fills its entry, 0 when the mesh changed or is not in that section */
+
+    const unsigned char *section = reuse != NULL ? reuse->section : NULL;
+    int previous = reuse != NULL ? reuse->previous[m] : -1;
+    uint32_t header[4], node_count, triangle_count;
+    uint64_t nodes_offset, triangles_offset, offset;
+
+    if (section == NULL || previous < 0 || reuse->length < sizeof(header))
+        return 0;
+
+    memcpy(header, section, sizeof(header));
+
+    if (header[1] != sizeof(FGM_BVHNode) || (uint32_t)previous >= header[0] || header[2] > reuse->length ||
+        (reuse->length - header[2]) / 32 <= (size_t)previous)
+        return 0;
+
+    const unsigned char *old = section + header[2] + 32*(size_t)previous;
+
+    memcpy(&node_count, old, 4);
+    memcpy(&triangle_count, old + 4, 4);
+    memcpy(&nodes_offset, old + 8, 8);
+    memcpy(&triangles_offset, old + 16, 8);
+
+    if (triangle_count > 0 &&
+        (nodes_offset > reuse->length || (reuse->length - nodes_offset) / sizeof(FGM_BVHNode) < node_count ||
+         triangles_offset > reuse->length || (reuse->length - triangles_offset) / 12 < triangle_count))
+        return 0;
+
+    memset(entry, 0, 32);
+    memcpy(entry, &node_count, 4);
+    memcpy(entry + 4, &triangle_count, 4);
+
+    if (triangle_count > 0) {
+        FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+        offset = FGM_BytesAppend(bytes, section + nodes_offset, sizeof(FGM_BVHNode)*(size_t)node_count);
+        memcpy(entry + 8, &offset, 8);
+        offset = FGM_BytesAppend(bytes, section + triangles_offset, 12*(size_t)triangle_count);
+        memcpy(entry + 16, &offset, 8);
+    }
+
+    reuse->reused++;
+    return 1;
+}
+
+int FGM_BuildBVH(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes,
+                 int threads, FGM_Reuse *reuse)
+{
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    int spawn = 0;
+    int status = 1;
+
+    /* every level of the tree handed to threads doubles them */
+    if (threads <= 0)
+        threads = cpu_count();
+    while ((1 << spawn) < threads)
+        spawn++;
+
+    uint32_t header[4] = { (uint32_t)num_meshes, (uint32_t)sizeof(FGM_BVHNode), 16, 0 };
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 32*(size_t)num_meshes);
+
+    for (int m = 0; status && m < num_meshes; m++) {
+        unsigned char copied[32];
+
+        if (copy_mesh(bytes, reuse, m, copied)) {
+            FGM_BytesPatch(bytes, 16 + 32*(size_t)m, copied, sizeof(copied));
+            continue;
+        }
+
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(gmeshes, m), "primitives"), 0);
+        Builder builder = { NULL, NULL, NULL, NULL };
+        NodeList nodes = { NULL, 0, 0, 0 };
+        uint32_t *triangles = NULL;
+        uint32_t triangle_count = 0;
+        uint64_t nodes_offset = 0, triangles_offset = 0;
+
+        if (!load_triangles(&builder, &triangles, &triangle_count, gprim, gson, bin, bin_length)) {
+            fprintf(stderr, "FGM_BuildBVH : Error, mesh %d has invalid triangles\n", m);
+            status = 0;
+        } else if (triangle_count > 0) {
+            build_node(&builder, &nodes, 0, triangle_count, 0, triangle_count >= FGM_BVH_PARALLEL ? spawn : 0);
+
+            if (nodes.failed) {
+                status = 0;
+            } else {
+                FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+                nodes_offset = FGM_BytesAppend(bytes, nodes.data, sizeof(FGM_BVHNode)*nodes.count);
+
+                /* vertex indices in leaf order */
+                triangles_offset = FGM_BytesAppend(bytes, NULL, sizeof(uint32_t)*3*(size_t)triangle_count);
+                for (uint32_t t = 0; !bytes->failed && t < triangle_count; t++)
+                    memcpy(bytes->data + triangles_offset + (size_t)t*12, triangles + builder.order[t]*3, 12);
+            }
+        }
+
+        unsigned char entry[32] = { 0 };
+        uint32_t node_count = (uint32_t)nodes.count;
+
+        memcpy(entry, &node_count, 4);
+        memcpy(entry + 4, &triangle_count, 4);
+        memcpy(entry + 8, &nodes_offset, 8);
+        memcpy(entry + 16, &triangles_offset, 8);
+        FGM_BytesPatch(bytes, 16 + 32*(size_t)m, entry, sizeof(entry));
+
+        free(nodes.data);
+        free(triangles);
+        free(builder.tri_min);
+        free(builder.tri_max);
+        free(builder.centroid);
+        free(builder.order);
+    }
+
+    return status && !bytes->failed;
+}
@@ -0,0 +1,472 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "fgm.h"
+#include "xxhash.h"
+
+/* Manifest layout, one entry per line after the header:
+ *
+ *    fgmcache <version>
+ *    <input hash> <options hash> <output hash> <output size> <mesh count> <mesh hash>...\t<input>\t<output>
+ *
+ * Hashes are written as 16 hex digits. Paths are last so they may contain
+ * spaces, only tabs and newlines are not supported. Saving takes a lock on
+ * <manifest>.lock, left in place afterwards */
+
+#define FGM_CACHE_MAX_MESHES 65535
+
+static char *copy_string(const char *s, size_t length)
+{
+    char *copy = malloc(length + 1);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+static void normalize_path(char *path)
+{
+    /* drops the ".", ".." and empty components of an absolute path in
+     * place, without resolving symbolic links */
+
+    const char *in = path;
+    char *out = path;
+
+    while (*in != '\0') {
+        const char *end;
+
+        while (*in == '/')
+            in++;
+        if ((end = strchr(in, '/')) == NULL)
+            end = in + strlen(in);
+
+        size_t length = (size_t)(end - in);
+
+        if (length == 2 && in[0] == '.' && in[1] == '.') {
+            while (out > path && *--out != '/')
+                ;
+        } else if (length > 0 && !(length == 1 && in[0] == '.')) {
+            *out++ = '/';
+            memmove(out, in, length);
+            out += length;
+        }
+
+        in = end;
+    }
+
+    if (out == path)
+        *out++ = '/';
+    *out = '\0';
+}
+
+static char *absolute_path(const char *path)
+{
+    /* outputs are keyed on absolute paths so converters started from
+     * different directories on one manifest do not mix up their outputs */
+
+    size_t size = 256;
+    char *cwd = NULL, *absolute;
+
+    if (path[0] == '/') {
+        if ((absolute = copy_string(path, strlen(path))) != NULL)
+            normalize_path(absolute);
+        return absolute;
+    }
+
+    for (;;) {
+        char *grown = realloc(cwd, size);
+
+        if (grown == NULL) {
+            free(cwd);
+            return NULL;
+        }
+
+        cwd = grown;
+        if (getcwd(cwd, size) != NULL)
+            break;
+
+        /* without a working directory the path is kept as given */
+        if (errno != ERANGE) {
+            free(cwd);
+            return copy_string(path, strlen(path));
+        }
+
+        size *= 2;
+    }
+
+    size = strlen(cwd) + strlen(path) + 2;
+    if ((absolute = malloc(size)) != NULL) {
+        snprintf(absolute, size, "%s/%s", cwd, path);
+        normalize_path(absolute);
+    }
+
+    free(cwd);
+    return absolute;
+}
+
+static void free_entry(struct CacheEntry *entry)
+{
+    free(entry->input);
+    free(entry->output);
+    free(entry->mesh_hashes);
+    memset(entry, 0, sizeof(struct CacheEntry));
+}
+
+static int parse_entry(struct CacheEntry *entry, char *line)
+{
+    char *cursor = line;
+    char *tab;
+    long count;
+
+    memset(entry, 0, sizeof(struct CacheEntry));
+
+    entry->input_hash = strtoull(cursor, &cursor, 16);
+    entry->options_hash = strtoull(cursor, &cursor, 16);
+    entry->output_hash = strtoull(cursor, &cursor, 16);
+    entry->output_size = strtoull(cursor, &cursor, 10);
+
+    count = strtol(cursor, &cursor, 10);
+    if (count < 0 || count > FGM_CACHE_MAX_MESHES)
+        goto fail;
+
+    if (count > 0) {
+        if ((entry->mesh_hashes = malloc(sizeof(uint64_t)*count)) == NULL)
+            goto fail;
+
+        entry->num_meshes = (int)count;
+        for (long i = 0; i < count; i++) {
+            if (*cursor != ' ')
+                goto fail;
+            entry->mesh_hashes[i] = strtoull(cursor, &cursor, 16);
+        }
+    }
+
+    if (*cursor != '\t')
+        goto fail;
+    cursor++;
+
+    if ((tab = strchr(cursor, '\t')) == NULL)
+        goto fail;
+
+    entry->input = copy_string(cursor, (size_t)(tab - cursor));
+    entry->output = copy_string(tab + 1, strlen(tab + 1));
+
+    if (entry->input == NULL || entry->output == NULL)
+        goto fail;
+
+    return 1;
+
+fail:
+    free_entry(entry);
+    return 0;
+}
+
+static int read_manifest(struct Cache *cache, const char *path, int report)
+{
+    /* a missing manifest is not an error, it is an empty cache */
+
+    size_t size = 0;
+    unsigned char *data, *terminated;
+    char *line, *end;
+
+    memset(cache, 0, sizeof(struct Cache));
+    cache->path = copy_string(path, strlen(path));
+    if (cache->path == NULL)
+        return 0;
+
+    if ((data = FGM_ReadFile(path, &size)) == NULL)
+        return 1;
+
+    if ((terminated = realloc(data, size + 1)) == NULL) {
+        free(data);
+        return 1;
+    }
+
+    data = terminated;
+    data[size] = '\0';
+
+    line = (char*)data;
+    end = strchr(line, '\n');
+
+    if (end == NULL || strncmp(line, "fgmcache ", 9) != 0 || atoi(line + 9) != FGM_CACHE_VERSION) {
+        if (report)
+            fprintf(stderr, "FGM_CacheLoad : ignoring outdated manifest %s\n", path);
+        goto done;
+    }
+
+    for (line = end + 1; *line != '\0'; line = end + 1) {
+        struct CacheEntry entry;
+
+        if ((end = strchr(line, '\n')) == NULL)
+            break;
+        *end = '\0';
+
+        if (!parse_entry(&entry, line))
+            continue;
+
+        struct CacheEntry *entries = realloc(cache->entries, sizeof(struct CacheEntry)*(cache->count + 1));
+        if (entries == NULL) {
+            free_entry(&entry);
+            break;
+        }
+
+        cache->entries = entries;
+        cache->entries[cache->count++] = entry;
+    }
+
+done:
+    free(data);
+    return 1;
+}
+
+int FGM_CacheLoad(struct Cache *cache, const char *path)
+{
+    return read_manifest(cache, path, 1);
+}
+
+static struct CacheEntry *find_entry(struct Cache *cache, const char *output)
+{
+    for (int i = 0; i < cache->count; i++) {
+        if (strcmp(cache->entries[i].output, output) == 0)
+            return &cache->entries[i];
+    }
+
+    return NULL;
+}
+
+static struct CacheEntry *update_entry(struct Cache *cache, char *input, char *output)
+{
+    /* the entry for output, cleared or created, taking input and output
+     * over. NULL when out of memory, they are then released */
+
+    struct CacheEntry *entry = find_entry(cache, output);
+
+    if (input == NULL || output == NULL)
+        goto fail;
+
+    if (entry == NULL) {
+        struct CacheEntry *entries = realloc(cache->entries, sizeof(struct CacheEntry)*(cache->count + 1));
+        if (entries == NULL)
+            goto fail;
+
+        cache->entries = entries;
+        entry = &cache->entries[cache->count++];
+    } else {
+        free_entry(entry);
+    }
+
+    memset(entry, 0, sizeof(struct CacheEntry));
+    entry->input = input;
+    entry->output = output;
+    entry->updated = 1;
+
+    return entry;
+
+fail:
+    free(input);
+    free(output);
+    return NULL;
+}
+
+static int merge_entry(struct Cache *cache, const struct CacheEntry *from)
+{
+    struct CacheEntry *entry = update_entry(cache, copy_string(from->input, strlen(from->input)),
+                                            copy_string(from->output, strlen(from->output)));
+
+    if (entry == NULL)
+        return 0;
+
+    entry->input_hash = from->input_hash;
+    entry->options_hash = from->options_hash;
+    entry->output_hash = from->output_hash;
+    entry->output_size = from->output_size;
+
+    if (from->num_meshes > 0) {
+        if ((entry->mesh_hashes = malloc(sizeof(uint64_t)*from->num_meshes)) == NULL)
+            return 0;
+
+        memcpy(entry->mesh_hashes, from->mesh_hashes, sizeof(uint64_t)*from->num_meshes);
+        entry->num_meshes = from->num_meshes;
+    }
+
+    return 1;
+}
+
+static int lock_manifest(const char *path)
+{
+    /* a file descriptor holding an exclusive lock on <path>.lock, released
+     * by closing it. -1 when the lock can not be taken */
+
+    size_t length = strlen(path) + sizeof(".lock");
+    char *lock_path = malloc(length);
+    struct flock lock;
+    int fd;
+
+    if (lock_path == NULL)
+        return -1;
+
+    snprintf(lock_path, length, "%s.lock", path);
+    fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    free(lock_path);
+
+    if (fd < 0)
+        return -1;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+
+    while (fcntl(fd, F_SETLKW, &lock) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+static int write_manifest(const struct Cache *cache)
+{
+    /* written next to the manifest then renamed over it, so a crash never
+     * leaves half a file */
+
+    size_t length = strlen(cache->path);
+    char *temp = malloc(length + 32);
+    FILE *fp;
+    int status;
+
+    if (temp == NULL)
+        return 0;
+
+    snprintf(temp, length + 32, "%s.%ld.tmp", cache->path, (long)getpid());
+
+    if ((fp = fopen(temp, "w")) == NULL) {
+        fprintf(stderr, "FGM_CacheSave : could not write manifest %s\n", temp);
+        free(temp);
+        return 0;
+    }
+
+    fprintf(fp, "fgmcache %d\n", FGM_CACHE_VERSION);
+
+    for (int i = 0; i < cache->count; i++) {
+        struct CacheEntry *entry = &cache->entries[i];
+
+        fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %" PRIu64 " %d",
+                entry->input_hash, entry->options_hash, entry->output_hash, entry->output_size,
+                entry->num_meshes);
+
+        for (int m = 0; m < entry->num_meshes; m++)
+            fprintf(fp, " %016" PRIx64, entry->mesh_hashes[m]);
+
+        fprintf(fp, "\t%s\t%s\n", entry->input, entry->output);
+    }
+
+    status = !ferror(fp);
+    status = fclose(fp) == 0 && status;
+
+    if (!status || rename(temp, cache->path) != 0) {
+        fprintf(stderr, "FGM_CacheSave : could not write manifest %s\n", cache->path);
+        remove(temp);
+        status = 0;
+    }
+
+    free(temp);
+    return status;
+}
+
+int FGM_CacheSave(struct Cache *cache)
+{
+    /* another converter may have saved since this one loaded the manifest,
+     * so it is read again under the lock and only the entries updated here
+     * replace what it holds */
+
+    struct Cache current;
+    int lock = lock_manifest(cache->path);
+    int status;
+
+    if (lock < 0)
+        fprintf(stderr, "FGM_CacheSave : could not lock %s, saving without\n", cache->path);
+
+    status = read_manifest(&current, cache->path, 0);
+
+    for (int i = 0; status && i < cache->count; i++) {
+        if (cache->entries[i].updated)
+            status = merge_entry(&current, &cache->entries[i]);
+    }
+
+    status = status && write_manifest(&current);
+
+    FGM_CacheFree(&current);
+    if (lock >= 0)
+        close(lock);
+
+    return status;
+}
+
+void FGM_CacheFree(struct Cache *cache)
+{
+    for (int i = 0; i < cache->count; i++)
+        free_entry(&cache->entries[i]);
+
+    free(cache->entries);
+    free(cache->path);
+    memset(cache, 0, sizeof(struct Cache));
+}
+
+struct CacheEntry *FGM_CacheFind(struct Cache *cache, const char *output)
+{
+    /* entries are keyed on the output, the same input may be converted
+     * to several outputs with different options */
+
+    char *absolute = absolute_path(output);
+    struct CacheEntry *entry = absolute != NULL ? find_entry(cache, absolute) : NULL;
+
+    free(absolute);
+    return entry;
+}
+
+struct CacheEntry *FGM_CacheUpdate(struct Cache *cache, const char *input, const char *output)
+{
+    /* returns the entry for output with its hashes cleared, creating it if
+     * needed, NULL when out of memory */
+
+    return update_entry(cache, absolute_path(input), absolute_path(output));
+}
+
+int FGM_HashFile(const char *path, uint64_t *hash, uint64_t *size)
+{
+    /* streams the file through XXH64 so large inputs are never fully loaded */
+
+    FILE *fp;
+    XXH64_State state;
+    unsigned char block[1 << 16];
+    size_t read;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        return 0;
+
+    XXH64_Init(&state, 0);
+    *size = 0;
+
+    while ((read = fread(block, 1, sizeof(block), fp)) > 0) {
+        XXH64_Update(&state, block, read);
+        *size += read;
+    }
+
+    fclose(fp);
+    *hash = XXH64_Digest(&state);
+
+    return 1;
+}
@@ -0,0 +1,602 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fgm.h"
+
+#define FGM_STREAM_BLOCK (1 << 16)
+
+/* one mesh stream of a streamed conversion, data that arrives before the
+ * streams in front of it are written is held until it can be */
+typedef struct
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t filled;  /* bytes received so far, they arrive in order */
+    uint64_t written;
+    unsigned char *held;
+} StreamSegment;
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t FGM_Size(const struct GLB_Meshes *meshes)
+{
+    size_t size = sizeof(uint16_t) + meshes->num_meshes*sizeof(struct BufferSizes) + meshes->length;
+
+    if (meshes->num_sections == 0)
+        return size;
+
+    size = align_up(size, FGM_SECTION_ALIGN);
+    for (int i = 0; i < meshes->num_sections; i++)
+        size += 16 + align_up(meshes->sections[i].length, FGM_SECTION_ALIGN);
+
+    return size + 16; /* footer */
+}
+
+size_t FGM_Write(const struct GLB_Meshes *meshes, unsigned char *dst)
+{
+    /* [number of meshes] [sizes of mesh 0] ... [sizes of mesh n] [buffer]
+     * then the sections and their footer if there are any, dst must hold
+     * FGM_Size bytes. Returns the bytes written */
+
+    unsigned char *cursor = dst;
+
+    memcpy(cursor, &meshes->num_meshes, sizeof(uint16_t));
+    cursor += sizeof(uint16_t);
+
+    for (int i = 0; i < meshes->num_meshes; i++) {
+        memcpy(cursor, &meshes->sizes[i].position, sizeof(uint64_t));
+        memcpy(cursor + 8, &meshes->sizes[i].normals, sizeof(uint64_t));
+        memcpy(cursor + 16, &meshes->sizes[i].texcoords, sizeof(uint64_t));
+        memcpy(cursor + 24, &meshes->sizes[i].indices, sizeof(uint64_t));
+        cursor += 4*sizeof(uint64_t);
+    }
+
+    if (meshes->length > 0)
+        memcpy(cursor, meshes->buffer, meshes->length);
+    cursor += meshes->length;
+
+    if (meshes->num_sections == 0)
+        return (size_t)(cursor - dst);
+
+    /* sections start aligned from the start of the file so they can be used
+     * straight from a mapping */
+    size_t padding = align_up((size_t)(cursor - dst), FGM_SECTION_ALIGN) - (size_t)(cursor - dst);
+    memset(cursor, 0, padding);
+    cursor += padding;
+
+    uint64_t first = (uint64_t)(cursor - dst);
+    uint32_t count = (uint32_t)meshes->num_sections;
+    uint32_t reserved = 0;
+
+    for (int i = 0; i < meshes->num_sections; i++) {
+        const struct GLB_Section *section = &meshes->sections[i];
+        uint64_t length = section->length;
+
+        memcpy(cursor, section->tag, 4);
+        memcpy(cursor + 4, &reserved, 4);
+        memcpy(cursor + 8, &length, 8);
+        cursor += 16;
+
+        if (section->length > 0)
+            memcpy(cursor, section->data, section->length);
+
+        padding = align_up(section->length, FGM_SECTION_ALIGN) - section->length;
+        memset(cursor + section->length, 0, padding);
+        cursor += section->length + padding;
+    }
+
+    memcpy(cursor, &first, 8);
+    memcpy(cursor + 8, &count, 4);
+    memcpy(cursor + 12, FGM_SECTION_MAGIC, 4);
+    cursor += 16;
+
+    return (size_t)(cursor - dst);
+}
+
+size_t FGM_BytesAppend(FGM_Bytes *bytes, const void *data, size_t length)
+{
+    /* appends length bytes, zeros when data is NULL. Returns their offset */
+
+    size_t offset = bytes->length;
+
+    if (bytes->failed)
+        return offset;
+
+    if (bytes->length + length > bytes->capacity) {
+        size_t capacity = bytes->capacity ? bytes->capacity : 256;
+        unsigned char *grown;
+
+        while (bytes->length + length > capacity)
+            capacity *= 2;
+
+        if ((grown = realloc(bytes->data, capacity)) == NULL) {
+            bytes->failed = 1;
+            return offset;
+        }
+
+        bytes->data = grown;
+        bytes->capacity = capacity;
+    }
+
+    if (data != NULL)
+        memcpy(bytes->data + offset, data, length);
+    else
+        memset(bytes->data + offset, 0, length);
+
+    bytes->length += length;
+
+    return offset;
+}
+
+size_t FGM_BytesAlign(FGM_Bytes *bytes, size_t alignment)
+{
+    FGM_BytesAppend(bytes, NULL, align_up(bytes->length, alignment) - bytes->length);
+    return bytes->length;
+}
+
+void FGM_BytesPatch(FGM_Bytes *bytes, size_t offset, const void *data, size_t length)
+{
+    /* overwrites bytes already appended, used to fill in tables */
+
+    if (!bytes->failed && offset + length <= bytes->length)
+        memcpy(bytes->data + offset, data, length);
+}
+
+int FGM_AddSection(struct GLB_Meshes *meshes, const char *tag, FGM_Bytes *bytes)
+{
+    /* meshes takes the bytes over, they are released either way */
+
+    struct GLB_Section *sections;
+
+    if (bytes->failed) {
+        free(bytes->data);
+        memset(bytes, 0, sizeof(FGM_Bytes));
+        return 0;
+    }
+
+    sections = realloc(meshes->sections, sizeof(struct GLB_Section)*(meshes->num_sections + 1));
+    if (sections == NULL) {
+        free(bytes->data);
+        memset(bytes, 0, sizeof(FGM_Bytes));
+        return 0;
+    }
+
+    meshes->sections = sections;
+    memcpy(sections[meshes->num_sections].tag, tag, 4);
+    sections[meshes->num_sections].data = bytes->data;
+    sections[meshes->num_sections].length = bytes->length;
+    meshes->num_sections++;
+
+    memset(bytes, 0, sizeof(FGM_Bytes));
+
+    return 1;
+}
+
+const unsigned char *FGM_FindSection(const unsigned char *fgm, size_t length, const char *tag, size_t *section_length)
+{
+    /* follows the footer to the section table, every header is checked to
+     * lie inside fgm before it is read */
+
+    uint64_t offset, section;
+    uint32_t count;
+
+    *section_length = 0;
+
+    if (fgm == NULL || length < 16 || memcmp(fgm + length - 4, FGM_SECTION_MAGIC, 4) != 0)
+        return NULL;
+
+    memcpy(&offset, fgm + length - 16, 8);
+    memcpy(&count, fgm + length - 8, 4);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset > length - 16 || length - 16 - offset < 16)
+            return NULL;
+
+        memcpy(&section, fgm + offset + 8, 8);
+
+        if (section > length - 16 - offset - 16)
+            return NULL;
+
+        if (memcmp(fgm + offset, tag, 4) == 0) {
+            *section_length = (size_t)section;
+            return fgm + offset + 16;
+        }
+
+        offset += 16 + align_up((size_t)section, FGM_SECTION_ALIGN);
+    }
+
+    return NULL;
+}
+
+int FGM_Convert(const unsigned char *glb, size_t length, const struct GLB_Options *options,
+                unsigned char **fgm, size_t *fgm_length)
+{
+    /* the returned buffer is owned by the caller and released with free() */
+
+    struct GLB_Meshes meshes;
+
+    *fgm = NULL;
+    *fgm_length = 0;
+
+    if (!GLB_Decode(&meshes, glb, length, options))
+        return 0;
+
+    *fgm = malloc(FGM_Size(&meshes));
+    if (*fgm == NULL) {
+        GLB_FreeMeshes(&meshes);
+        return 0;
+    }
+
+    *fgm_length = FGM_Write(&meshes, *fgm);
+    GLB_FreeMeshes(&meshes);
+
+    return 1;
+}
+
+int FGM_ConvertInto(const unsigned char *glb, size_t length, const struct GLB_Options *options,
+                    unsigned char *dst, size_t capacity, size_t *fgm_length)
+{
+    /* writes into a caller owned buffer. When it is too small nothing is
+     * written, 0 is returned and fgm_length holds the size needed */
+
+    struct GLB_Meshes meshes;
+
+    *fgm_length = 0;
+
+    if (!GLB_Decode(&meshes, glb, length, options))
+        return 0;
+
+    *fgm_length = FGM_Size(&meshes);
+    if (*fgm_length > capacity) {
+        GLB_FreeMeshes(&meshes);
+        return 0;
+    }
+
+    FGM_Write(&meshes, dst);
+    GLB_FreeMeshes(&meshes);
+
+    return 1;
+}
+
+unsigned char *FGM_ReadFile(const char *path, size_t *size)
+{
+    FILE *fp;
+    long length;
+    unsigned char *data;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        return NULL;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0) {
+        fclose(fp);
+        return NULL;
+    }
+    rewind(fp);
+
+    data = malloc(length > 0 ? (size_t)length : 1);
+    if (data == NULL || fread(data, 1, (size_t)length, fp) != (size_t)length) {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+
+    fclose(fp);
+    *size = (size_t)length;
+
+    return data;
+}
+
+static int read_exact(FILE *fp, void *data, size_t length)
+{
+    return length == 0 || fread(data, 1, length, fp) == length;
+}
+
+static unsigned char *read_stream(FILE *fp, unsigned char *data, size_t *length, size_t limit)
+{
+    /* reads the rest of fp after the length bytes already in data, up to
+     * limit bytes in all. The buffer grows with what arrives rather than
+     * with what the GLB header claims */
+
+    size_t capacity = *length;
+    size_t read = 1;
+
+    while (data != NULL && *length < limit && read > 0) {
+        if (*length == capacity) {
+            size_t next = capacity < FGM_STREAM_BLOCK ? FGM_STREAM_BLOCK : capacity*2;
+            unsigned char *grown = realloc(data, next < limit ? next : limit);
+
+            if (grown == NULL) {
+                free(data);
+                return NULL;
+            }
+
+            data = grown;
+            capacity = next < limit ? next : limit;
+        }
+
+        read = fread(data + *length, 1, capacity - *length, fp);
+        *length += read;
+    }
+
+    return data;
+}
+
+static int flush_segments(StreamSegment *segments, int count, int *cursor, FILE *out)
+{
+    /* writes everything that can be written in FGM order */
+
+    while (*cursor < count) {
+        StreamSegment *s = &segments[*cursor];
+
+        if (s->written < s->filled) {
+            if (fwrite(s->held + s->written, 1, s->filled - s->written, out) != s->filled - s->written)
+                return 0;
+            s->written = s->filled;
+        }
+
+        if (s->written < s->length)
+            break;
+
+        free(s->held);
+        s->held = NULL;
+        (*cursor)++;
+    }
+
+    return 1;
+}
+
+static int compare_segments(const void *a, const void *b)
+{
+    const StreamSegment *sa = *(const StreamSegment* const*)a;
+    const StreamSegment *sb = *(const StreamSegment* const*)b;
+
+    return (sa->offset > sb->offset) - (sa->offset < sb->offset);
+}
+
+static int stream_bin(const struct GLB_Layout *layout, uint64_t bin_length, FILE *in, FILE *out,
+                      struct ConvertStats *stats)
+{
+    /* the BIN chunk is read block by block. Each block goes straight to out
+     * when it belongs to the stream being written, otherwise it is held
+     * until the streams before it are done. A GLB whose bufferViews are in
+     * mesh order, which is what exporters write, never holds anything */
+
+    int count = layout->num_meshes*4;
+    int cursor = 0, next = 0, active_count = 0, status = 0;
+    uint64_t position = 0;
+
+    StreamSegment *segments = calloc(count, sizeof(StreamSegment));
+    StreamSegment **order = malloc(sizeof(StreamSegment*)*count);
+    StreamSegment **active = malloc(sizeof(StreamSegment*)*count);
+    unsigned char *block = malloc(FGM_STREAM_BLOCK);
+
+    if (segments == NULL || order == NULL || active == NULL || block == NULL)
+        goto done;
+
+    for (int i = 0; i < count; i++) {
+        segments[i].offset = layout->ranges[i].offset;
+        segments[i].length = layout->ranges[i].length;
+        order[i] = &segments[i];
+    }
+
+    qsort(order, count, sizeof(StreamSegment*), compare_segments);
+
+    if (!flush_segments(segments, count, &cursor, out))
+        goto done;
+
+    while (position < bin_length) {
+        size_t length = bin_length - position < FGM_STREAM_BLOCK ? (size_t)(bin_length - position) : FGM_STREAM_BLOCK;
+
+        if (!read_exact(in, block, length)) {
+            fprintf(stderr, "FGM_ConvertStream : BIN chunk ended early\n");
+            goto done;
+        }
+
+        /* streams starting in this block become active */
+        while (next < count && order[next]->offset < position + length)
+            active[active_count++] = order[next++];
+
+        for (int i = 0; i < active_count; i++) {
+            StreamSegment *s = active[i];
+            uint64_t start = s->offset + s->filled;
+            uint64_t end = s->offset + s->length < position + length ? s->offset + s->length : position + length;
+
+            if (end <= start)
+                continue;
+
+            if (s == &segments[cursor] && s->written == s->filled) {
+                if (fwrite(block + (start - position), 1, end - start, out) != end - start)
+                    goto done;
+                s->written += end - start;
+            } else {
+                if (s->held == NULL && (s->held = malloc(s->length)) == NULL)
+                    goto done;
+
+                memcpy(s->held + s->filled, block + (start - position), end - start);
+
+                if (stats != NULL)
+                    stats->bytes_copied += end - start;
+            }
+
+            s->filled += end - start;
+
+            if (!flush_segments(segments, count, &cursor, out))
+                goto done;
+        }
+
+        /* done streams are dropped */
+        for (int i = 0; i < active_count; i++) {
+            if (active[i]->filled == active[i]->length)
+                active[i--] = active[--active_count];
+        }
+
+        position += length;
+    }
+
+    status = cursor == count;
+
+done:
+    if (segments != NULL) {
+        for (int i = 0; i < count; i++)
+            free(segments[i].held);
+    }
+
+    free(segments);
+    free(order);
+    free(active);
+    free(block);
+
+    return status;
+}
+
+static int convert_buffered(unsigned char *data, size_t length, size_t total, FILE *in, FILE *out,
+                            const struct GLB_Options *options)
+{
+    /* data holds the first length bytes of the GLB, the rest of its total
+     * bytes is read from in and the whole of it converted in memory. data
+     * is released */
+
+    unsigned char *fgm = NULL;
+    size_t fgm_length = 0;
+    int status;
+
+    if (data == NULL || (data = read_stream(in, data, &length, total)) == NULL)
+        return 0;
+
+    status = FGM_Convert(data, length, options, &fgm, &fgm_length) &&
+             fwrite(fgm, 1, fgm_length, out) == fgm_length;
+
+    if (options->stats != NULL)
+        options->stats->bytes_written += fgm_length;
+
+    free(data);
+    free(fgm);
+
+    return status;
+}
+
+int FGM_ConvertStream(FILE *in, FILE *out, const struct GLB_Options *options)
+{
+    /* converts a GLB read from in, which does not need to be seekable, into
+     * an FGM written to out. Only the JSON chunk and one block of the BIN
+     * chunk are kept in memory, plus the streams that arrive before the
+     * ones in front of them. Options that need whole meshes, and
+     * interleaved streams, fall back to reading the GLB into memory */
+
+    struct GLB_Options defaults = { 0, NULL };
+    struct GLB_Layout layout;
+    struct ConvertStats *stats;
+    unsigned char header[20], bin_header[8];
+    unsigned char *json = NULL;
+    uint32_t total, json_length, chunk_type, bin_length;
+    StatsClock clock;
+    int status = 0;
+
+    if (options == NULL)
+        options = &defaults;
+    stats = options->stats;
+
+    if (!read_exact(in, header, 20) || !GLB_CheckHeader(header)) {
+        fprintf(stderr, "FGM_ConvertStream : not a GLB version 2 stream\n");
+        return 0;
+    }
+
+    memcpy(&total, header + 8, 4);
+    memcpy(&json_length, header + 12, 4);
+    memcpy(&chunk_type, header + 16, 4);
+
+    /* the JSON chunk is allocated before anything else arrives, so its
+     * length is checked against the GLB length and capped */
+    if (total < 28 || json_length > total - 28 || json_length > FGM_STREAM_MAX_JSON) {
+        fprintf(stderr, "FGM_ConvertStream : Error, JSON chunk of %u bytes in a GLB of %u bytes\n", json_length, total);
+        return 0;
+    }
+
+    if (options->flags != 0) {
+        unsigned char *data = malloc(sizeof(header));
+
+        if (data != NULL)
+            memcpy(data, header, sizeof(header));
+
+        return convert_buffered(data, sizeof(header), total, in, out, options);
+    }
+
+    FGM_StatsStart(&clock);
+
+    if (chunk_type != GLB_CHUNK_JSON || (json = malloc(json_length > 0 ? json_length : 1)) == NULL ||
+        !read_exact(in, json, json_length) || !read_exact(in, bin_header, 8)) {
+        fprintf(stderr, "read_chunk : could not read json chunk\n");
+        free(json);
+        return 0;
+    }
+
+    memcpy(&bin_length, bin_header, 4);
+    memcpy(&chunk_type, bin_header + 4, 4);
+
+    FGM_StatsStop(stats, FGM_STAGE_READ, &clock);
+
+    if (chunk_type != GLB_CHUNK_BIN || bin_length > total - 28 - json_length) {
+        fprintf(stderr, "read_chunk : could not read bin chunk\n");
+        free(json);
+        return 0;
+    }
+
+    int decoded = GLB_DecodeLayout(&layout, json, json_length, bin_length, options);
+    int strided = 0;
+
+    for (int i = 0; decoded && i < layout.num_meshes*4; i++)
+        strided |= layout.ranges[i].stride != 0;
+
+    if (strided) {
+        /* what was read so far is put back in front of the rest */
+        size_t length = sizeof(header) + json_length + sizeof(bin_header);
+        unsigned char *data = malloc(length);
+
+        if (data != NULL) {
+            memcpy(data, header, sizeof(header));
+            memcpy(data + sizeof(header), json, json_length);
+            memcpy(data + sizeof(header) + json_length, bin_header, sizeof(bin_header));
+        }
+
+        free(json);
+        GLB_FreeLayout(&layout);
+
+        return convert_buffered(data, length, total, in, out, options);
+    }
+
+    free(json);
+
+    if (!decoded)
+        return 0;
+
+    /* the header only depends on the JSON chunk so it goes out first */
+    FGM_StatsStart(&clock);
+
+    struct GLB_Meshes meshes = { layout.num_meshes, layout.sizes, NULL, 0 };
+    size_t header_length = FGM_Size(&meshes);
+    unsigned char *fgm_header = malloc(header_length);
+
+    if (fgm_header != NULL) {
+        FGM_Write(&meshes, fgm_header);
+
+        status = fwrite(fgm_header, 1, header_length, out) == header_length &&
+                 stream_bin(&layout, bin_length, in, out, stats);
+    }
+
+    if (stats != NULL) {
+        stats->bytes_written += header_length;
+        for (int i = 0; i < layout.num_meshes*4; i++)
+            stats->bytes_written += layout.ranges[i].length;
+    }
+
+    FGM_StatsStop(stats, FGM_STAGE_EXTRACT, &clock);
+
+    free(fgm_header);
+    GLB_FreeLayout(&layout);
+
+    return status;
+}
@@ -0,0 +1,560 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flatten.h"
+#include "accessor.h"
+#include "fgm.h"
+
+enum
+{
+    STREAM_POSITION,
+    STREAM_NORMAL,
+    STREAM_TEXCOORD,
+    STREAM_INDICES,
+    STREAM_COUNT,
+};
+
+typedef struct
+{
+    int material;  /* -1 without one */
+    int node;      /* the dynamic node drawing it, -1 for merged static instances */
+    int open;      /* static instances of the same material can still be added */
+    uint32_t vertex_count;
+    FGM_Bytes streams[STREAM_COUNT];
+} Batch;
+
+typedef struct
+{
+    float *world;    /* 16 floats per node, column major */
+    int *parent;     /* -1 for roots and nodes outside of the scene */
+    char *visited;
+    char *dynamic;   /* animated, skinned or below such a node */
+    int *instances;  /* nodes with a mesh in scene order */
+    int instance_count;
+    int node_count;
+} Scene;
+
+static void mat4_mul(const float *a, const float *b, float *out)
+{
+    float r[16];
+
+    for (int c = 0; c < 4; c++) {
+        for (int row = 0; row < 4; row++) {
+            r[c*4 + row] = a[row]*b[c*4] + a[4 + row]*b[c*4 + 1] + a[8 + row]*b[c*4 + 2] + a[12 + row]*b[c*4 + 3];
+        }
+    }
+
+    memcpy(out, r, sizeof(r));
+}
+
+static void read_numbers(gJSON *array, float *out, int count)
+{
+    gJSON *item = gJSON_GetArrayItem(array, 0);
+
+    for (int i = 0; i < count && item != NULL; i++, item = item->next)
+        out[i] = (float)item->valuedouble;
+}
+
+static void local_matrix(gJSON *node, float *m)
+{
+    /* matrix when given, otherwise T * R * S */
+
+    float t[3] = { 0, 0, 0 }, r[4] = { 0, 0, 0, 1 }, s[3] = { 1, 1, 1 };
+    gJSON *matrix = gJSON_GetObjectItem(node, "matrix");
+
+    if (matrix != NULL) {
+        float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+        memcpy(m, identity, sizeof(identity));
+        read_numbers(matrix, m, 16);
+        return;
+    }
+
+    read_numbers(gJSON_GetObjectItem(node, "translation"), t, 3);
+    read_numbers(gJSON_GetObjectItem(node, "rotation"), r, 4);
+    read_numbers(gJSON_GetObjectItem(node, "scale"), s, 3);
+
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+
+    m[0] = (1 - 2*(y*y + z*z))*s[0];
+    m[1] = (2*(x*y + z*w))*s[0];
+    m[2] = (2*(x*z - y*w))*s[0];
+    m[3] = 0;
+    m[4] = (2*(x*y - z*w))*s[1];
+    m[5] = (1 - 2*(x*x + z*z))*s[1];
+    m[6] = (2*(y*z + x*w))*s[1];
+    m[7] = 0;
+    m[8] = (2*(x*z + y*w))*s[2];
+    m[9] = (2*(y*z - x*w))*s[2];
+    m[10] = (1 - 2*(x*x + y*y))*s[2];
+    m[11] = 0;
+    m[12] = t[0];
+    m[13] = t[1];
+    m[14] = t[2];
+    m[15] = 1;
+}
+
+static int walk_node(Scene *scene, gJSON *gnodes, int index, int parent_index, const float *parent, int dynamic)
+{
+    /* depth first so instances keep the order of the scene, a node is only
+     * visited once which also stops cycles */
+
+    gJSON *node = gJSON_GetArrayItem(gnodes, index);
+    float local[16];
+
+    if (node == NULL || index < 0 || index >= scene->node_count || scene->visited[index])
+        return 1;
+
+    scene->visited[index] = 1;
+    scene->parent[index] = parent_index;
+    scene->dynamic[index] |= dynamic || gJSON_GetObjectItem(node, "skin") != NULL;
+
+    local_matrix(node, local);
+    mat4_mul(parent, local, scene->world + index*16);
+
+    if (gJSON_GetObjectItem(node, "mesh") != NULL)
+        scene->instances[scene->instance_count++] = index;
+
+    for (gJSON *child = gJSON_GetArrayItem(gJSON_GetObjectItem(node, "children"), 0); child != NULL;
+         child = child->next) {
+        walk_node(scene, gnodes, child->valueint, index, scene->world + index*16, scene->dynamic[index]);
+    }
+
+    return 1;
+}
+
+static int walk_scene(Scene *scene, gJSON *gson)
+{
+    gJSON *gnodes = gJSON_GetObjectItem(gson, "nodes");
+    gJSON *gscene = gJSON_GetObjectItem(gson, "scene");
+    gJSON *groots = gJSON_GetObjectItem(gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "scenes"),
+                                                           gscene != NULL ? gscene->valueint : 0), "nodes");
+    float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    int node_count = 0;
+
+    for (gJSON *node = gJSON_GetArrayItem(gnodes, 0); node != NULL; node = node->next)
+        node_count++;
+
+    memset(scene, 0, sizeof(Scene));
+    scene->node_count = node_count;
+    scene->world = malloc(sizeof(float)*16*(node_count > 0 ? node_count : 1));
+    scene->parent = malloc(sizeof(int)*(node_count > 0 ? node_count : 1));
+    scene->visited = calloc(node_count > 0 ? node_count : 1, 1);
+    scene->dynamic = calloc(node_count > 0 ? node_count : 1, 1);
+    scene->instances = malloc(sizeof(int)*(node_count > 0 ? node_count : 1));
+
+    if (scene->world == NULL || scene->parent == NULL || scene->visited == NULL || scene->dynamic == NULL ||
+        scene->instances == NULL)
+        return 0;
+
+    for (int i = 0; i < node_count; i++)
+        scene->parent[i] = -1;
+
+    /* animated nodes keep their transform out of the vertices */
+    gJSON *ganimation = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "animations"), 0);
+
+    for (; ganimation != NULL; ganimation = ganimation->next) {
+        gJSON *gchannel = gJSON_GetArrayItem(gJSON_GetObjectItem(ganimation, "channels"), 0);
+
+        for (; gchannel != NULL; gchannel = gchannel->next) {
+            gJSON *target = gJSON_GetObjectItem(gJSON_GetObjectItem(gchannel, "target"), "node");
+
+            if (target != NULL && target->valueint >= 0 && target->valueint < node_count)
+                scene->dynamic[target->valueint] = 1;
+        }
+    }
+
+    if (groots != NULL) {
+        for (gJSON *root = gJSON_GetArrayItem(groots, 0); root != NULL; root = root->next)
+            walk_node(scene, gnodes, root->valueint, -1, identity, 0);
+        return 1;
+    }
+
+    /* no scene, every node that is nobody's child is a root */
+    char *is_child = calloc(node_count > 0 ? node_count : 1, 1);
+    if (is_child == NULL)
+        return 0;
+
+    for (gJSON *node = gJSON_GetArrayItem(gnodes, 0); node != NULL; node = node->next) {
+        for (gJSON *child = gJSON_GetArrayItem(gJSON_GetObjectItem(node, "children"), 0); child != NULL;
+             child = child->next) {
+            if (child->valueint >= 0 && child->valueint < node_count)
+                is_child[child->valueint] = 1;
+        }
+    }
+
+    for (int i = 0; i < node_count; i++) {
+        if (!is_child[i])
+            walk_node(scene, gnodes, i, -1, identity, 0);
+    }
+
+    free(is_child);
+
+    return 1;
+}
+
+static void free_scene(Scene *scene)
+{
+    free(scene->world);
+    free(scene->parent);
+    free(scene->visited);
+    free(scene->dynamic);
+    free(scene->instances);
+}
+
+static int wide_indices(gJSON *gson)
+{
+    /* 32-bit indices in the output as soon as one mesh has them */
+
+    gJSON *gaccessors = gJSON_GetObjectItem(gson, "accessors");
+
+    for (gJSON *gmesh = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "meshes"), 0); gmesh != NULL;
+         gmesh = gmesh->next) {
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gmesh, "primitives"), 0);
+
+        for (; gprim != NULL; gprim = gprim->next) {
+            gJSON *gindices = gJSON_GetObjectItem(gprim, "indices");
+            gJSON *type = gJSON_GetObjectItem(gJSON_GetArrayItem(gaccessors, gindices != NULL ? gindices->valueint : -1),
+                                              "componentType");
+
+            if (gindices == NULL || (type != NULL && type->valueint == 5125))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int append_instance(Batch *batch, gJSON *gprim, gJSON *gson, const unsigned char *bin, size_t bin_length,
+                           const float *world, int wide)
+{
+    /* transforms the primitive by world into the batch, world is NULL for
+     * meshes kept in their own space */
+
+    gJSON *gattr = gJSON_GetObjectItem(gprim, "attributes");
+    gJSON *sources[STREAM_COUNT] = {
+        gJSON_GetObjectItem(gattr, "POSITION"),
+        gJSON_GetObjectItem(gattr, "NORMAL"),
+        gJSON_GetObjectItem(gattr, "TEXCOORD_0"),
+        gJSON_GetObjectItem(gprim, "indices"),
+    };
+    GLB_Accessor accessors[STREAM_COUNT];
+    float *positions = NULL, *normals = NULL, *texcoords = NULL;
+    uint32_t *indices = NULL;
+    int index_count;
+    int status = 0;
+
+    for (int i = 0; i < STREAM_COUNT; i++) {
+        if (sources[i] == NULL && i != STREAM_INDICES)
+            return 0;
+        if (sources[i] != NULL && !GLB_GetAccessor(&accessors[i], gson, sources[i]->valueint, bin, bin_length))
+            return 0;
+    }
+
+    int vertex_count = accessors[STREAM_POSITION].count;
+
+    if (accessors[STREAM_NORMAL].count != vertex_count || accessors[STREAM_TEXCOORD].count != vertex_count)
+        return 0;
+
+    positions = GLB_ReadFloats(&accessors[STREAM_POSITION], 3);
+    normals = GLB_ReadFloats(&accessors[STREAM_NORMAL], 3);
+    texcoords = GLB_ReadFloats(&accessors[STREAM_TEXCOORD], 2);
+
+    if (sources[STREAM_INDICES] != NULL) {
+        indices = GLB_ReadUints(&accessors[STREAM_INDICES], 1);
+        index_count = accessors[STREAM_INDICES].count;
+    } else {
+        indices = malloc(sizeof(uint32_t)*(vertex_count > 0 ? vertex_count : 1));
+        for (int i = 0; indices != NULL && i < vertex_count; i++)
+            indices[i] = (uint32_t)i;
+        index_count = vertex_count;
+    }
+
+    if (positions == NULL || normals == NULL || texcoords == NULL || indices == NULL)
+        goto end;
+
+    if (world != NULL) {
+        /* normals use the cofactor matrix, the inverse transpose times the
+         * determinant. Its columns are the cross products of the columns
+         * a0 a1 a2 of the upper 3x3 : a1 x a2, a2 x a0 and a0 x a1. The
+         * sign of the determinant keeps them facing out and a mirroring
+         * transform also flips the winding */
+        const float *m = world;
+        float n[9] = {
+            m[5]*m[10] - m[6]*m[9], m[6]*m[8] - m[4]*m[10], m[4]*m[9] - m[5]*m[8],
+            m[9]*m[2] - m[10]*m[1], m[10]*m[0] - m[8]*m[2], m[8]*m[1] - m[9]*m[0],
+            m[1]*m[6] - m[2]*m[5], m[2]*m[4] - m[0]*m[6], m[0]*m[5] - m[1]*m[4],
+        };
+        float det = m[0]*n[0] + m[1]*n[1] + m[2]*n[2];
+        float sign = det < 0.0f ? -1.0f : 1.0f;
+
+        for (int v = 0; v < vertex_count; v++) {
+            float *p = positions + v*3, *nr = normals + v*3;
+            float x = p[0], y = p[1], z = p[2];
+            float nx = nr[0], ny = nr[1], nz = nr[2];
+
+            p[0] = m[0]*x + m[4]*y + m[8]*z + m[12];
+            p[1] = m[1]*x + m[5]*y + m[9]*z + m[13];
+            p[2] = m[2]*x + m[6]*y + m[10]*z + m[14];
+
+            nr[0] = (n[0]*nx + n[3]*ny + n[6]*nz)*sign;
+            nr[1] = (n[1]*nx + n[4]*ny + n[7]*nz)*sign;
+            nr[2] = (n[2]*nx + n[5]*ny + n[8]*nz)*sign;
+
+            float length = sqrtf(nr[0]*nr[0] + nr[1]*nr[1] + nr[2]*nr[2]);
+            if (length > 0.0f) {
+                nr[0] /= length;
+                nr[1] /= length;
+                nr[2] /= length;
+            }
+        }
+
+        if (det < 0.0f) {
+            for (int i = 0; i + 2 < index_count; i += 3) {
+                uint32_t swap = indices[i + 1];
+                indices[i + 1] = indices[i + 2];
+                indices[i + 2] = swap;
+            }
+        }
+    }
+
+    FGM_BytesAppend(&batch->streams[STREAM_POSITION], positions, sizeof(float)*3*(size_t)vertex_count);
+    FGM_BytesAppend(&batch->streams[STREAM_NORMAL], normals, sizeof(float)*3*(size_t)vertex_count);
+    FGM_BytesAppend(&batch->streams[STREAM_TEXCOORD], texcoords, sizeof(float)*2*(size_t)vertex_count);
+
+    /* rebased on the vertices already in the batch */
+    for (int i = 0; i < index_count; i++) {
+        uint32_t index = indices[i];
+
+        if (index >= (uint32_t)vertex_count) {
+            fprintf(stderr, "GLB_Flatten : Error, index %u out of %d vertices\n", index, vertex_count);
+            goto end;
+        }
+
+        index += batch->vertex_count;
+
+        if (wide) {
+            FGM_BytesAppend(&batch->streams[STREAM_INDICES], &index, sizeof(uint32_t));
+        } else {
+            uint16_t narrow = (uint16_t)index;
+            FGM_BytesAppend(&batch->streams[STREAM_INDICES], &narrow, sizeof(uint16_t));
+        }
+    }
+
+    batch->vertex_count += (uint32_t)vertex_count;
+    status = 1;
+
+end:
+    free(positions);
+    free(normals);
+    free(texcoords);
+    free(indices);
+
+    return status;
+}
+
+static Batch *find_batch(Batch **batches, int *batch_count, int material, int node, uint32_t vertices, int wide)
+{
+    /* the open batch of material with room left, or a new one. node is the
+     * dynamic node the primitive belongs to, which always gets its own */
+
+    int dynamic = node >= 0;
+
+    for (int i = 0; !dynamic && i < *batch_count; i++) {
+        Batch *batch = &(*batches)[i];
+
+        if (batch->open && batch->material == material) {
+            if (wide || batch->vertex_count + vertices <= GLB_BATCH_MAX_VERTICES)
+                return batch;
+
+            batch->open = 0;
+        }
+    }
+
+    Batch *grown = realloc(*batches, sizeof(Batch)*(*batch_count + 1));
+    if (grown == NULL)
+        return NULL;
+
+    *batches = grown;
+    memset(&grown[*batch_count], 0, sizeof(Batch));
+    grown[*batch_count].material = material;
+    grown[*batch_count].node = node;
+    grown[*batch_count].open = !dynamic;
+
+    return &grown[(*batch_count)++];
+}
+
+static int add_nodes(struct GLB_Meshes *meshes, gJSON *gnodes, const Scene *scene, const Batch *batches,
+                     int batch_count)
+{
+    /* the NODE section, so that dynamic batches can be placed at runtime */
+
+    FGM_Bytes bytes = { NULL, 0, 0, 0 };
+    uint32_t node_count = gnodes != NULL ? (uint32_t)scene->node_count : 0;
+    uint32_t header[4] = { node_count, (uint32_t)batch_count, 16, 16 + 80*node_count };
+
+    FGM_BytesAppend(&bytes, header, sizeof(header));
+    size_t nodes_offset = FGM_BytesAppend(&bytes, NULL, 80*(size_t)node_count);
+
+    for (int b = 0; b < batch_count; b++) {
+        int32_t node = batches[b].node;
+        FGM_BytesAppend(&bytes, &node, sizeof(int32_t));
+    }
+
+    gJSON *gnode = gJSON_GetArrayItem(gnodes, 0);
+
+    for (uint32_t n = 0; !bytes.failed && n < node_count; n++, gnode = gnode->next) {
+        /* int32 parent, uint32 first batch, uint32 batch count, uint32 flags, float local[16] */
+        int32_t entry[4] = { scene->parent[n], 0, 0, scene->dynamic[n] ? FGM_NODE_DYNAMIC : 0 };
+        float local[16];
+
+        local_matrix(gnode, local);
+        memcpy(bytes.data + nodes_offset + 80*(size_t)n, entry, sizeof(entry));
+        memcpy(bytes.data + nodes_offset + 80*(size_t)n + 16, local, sizeof(local));
+    }
+
+    /* the batches of a dynamic node follow each other */
+    for (int b = 0; !bytes.failed && b < batch_count; b++) {
+        unsigned char *entry = bytes.data + nodes_offset + 80*(size_t)batches[b].node;
+        uint32_t first = (uint32_t)b, count;
+
+        if (batches[b].node < 0)
+            continue;
+
+        memcpy(&count, entry + 8, 4);
+        if (count++ == 0)
+            memcpy(entry + 4, &first, 4);
+        memcpy(entry + 8, &count, 4);
+    }
+
+    return FGM_AddSection(meshes, FGM_SECTION_NODES, &bytes);
+}
+
+int GLB_Flatten(struct GLB_Meshes *meshes, gJSON *gson, const unsigned char *bin, size_t bin_length,
+                const struct GLB_Options *options)
+{
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    gJSON *gaccessors = gJSON_GetObjectItem(gson, "accessors");
+    Batch *batches = NULL;
+    int batch_count = 0;
+    int wide = wide_indices(gson);
+    int status = 0;
+    Scene scene;
+
+    if (!walk_scene(&scene, gson)) {
+        fprintf(stderr, "GLB_Flatten : Error, out of memory\n");
+        goto end;
+    }
+
+    /* without any node every mesh is placed once, as it is */
+    gJSON *gnodes = gJSON_GetObjectItem(gson, "nodes");
+    float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    int instance_count = scene.instance_count;
+
+    if (gnodes == NULL) {
+        for (gJSON *gmesh = gJSON_GetArrayItem(gmeshes, 0); gmesh != NULL; gmesh = gmesh->next)
+            instance_count++;
+    }
+
+    for (int i = 0; i < instance_count; i++) {
+        int node = gnodes != NULL ? scene.instances[i] : -1;
+        int mesh = gnodes != NULL ? gJSON_GetObjectItem(gJSON_GetArrayItem(gnodes, node), "mesh")->valueint : i;
+        int dynamic = gnodes != NULL && scene.dynamic[node];
+        const float *world = gnodes != NULL ? scene.world + node*16 : identity;
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(gmeshes, mesh), "primitives"), 0);
+
+        if (gprim == NULL) {
+            fprintf(stderr, "GLB_Flatten : Error, node %d has an invalid mesh\n", node);
+            goto end;
+        }
+
+        /* every primitive, those of a dynamic node in consecutive batches */
+        for (int p = 0; gprim != NULL; p++, gprim = gprim->next) {
+            gJSON *gmaterial = gJSON_GetObjectItem(gprim, "material");
+            gJSON *gposition = gJSON_GetObjectItem(gJSON_GetObjectItem(gprim, "attributes"), "POSITION");
+            gJSON *gcount = gJSON_GetObjectItem(gJSON_GetArrayItem(gaccessors,
+                                                gposition != NULL ? gposition->valueint : -1), "count");
+
+            if (gcount == NULL) {
+                fprintf(stderr, "GLB_Flatten : Error, primitive %d of mesh %d has no POSITION\n", p, mesh);
+                goto end;
+            }
+
+            Batch *batch = find_batch(&batches, &batch_count, gmaterial != NULL ? gmaterial->valueint : -1,
+                                      dynamic ? node : -1, (uint32_t)gcount->valueint, wide);
+
+            if (batch == NULL || !append_instance(batch, gprim, gson, bin, bin_length, dynamic ? NULL : world, wide)) {
+                fprintf(stderr, "GLB_Flatten : Error, primitive %d of mesh %d of node %d needs POSITION, NORMAL "
+                        "and TEXCOORD_0\n", p, mesh, node);
+                goto end;
+            }
+        }
+    }
+
+    if (batch_count == 0) {
+        fprintf(stderr, "GLB_Flatten : Error, the scene has no meshes\n");
+        goto end;
+    }
+
+    if (batch_count > UINT16_MAX) {
+        fprintf(stderr, "GLB_Flatten : Error, more than %d batches\n", UINT16_MAX);
+        goto end;
+    }
+
+    /* batches in the FGM order, one after the other */
+    size_t length = 0;
+
+    for (int b = 0; b < batch_count; b++) {
+        for (int s = 0; s < STREAM_COUNT; s++) {
+            if (batches[b].streams[s].failed)
+                goto end;
+            length += batches[b].streams[s].length;
+        }
+    }
+
+    meshes->sizes = malloc(sizeof(struct BufferSizes)*batch_count);
+    meshes->buffer = malloc(length > 0 ? length : 1);
+
+    if (meshes->sizes == NULL || meshes->buffer == NULL)
+        goto end;
+
+    for (int b = 0; b < batch_count; b++) {
+        FGM_Bytes *streams = batches[b].streams;
+
+        meshes->sizes[b].position = streams[STREAM_POSITION].length;
+        meshes->sizes[b].normals = streams[STREAM_NORMAL].length;
+        meshes->sizes[b].texcoords = streams[STREAM_TEXCOORD].length;
+        meshes->sizes[b].indices = streams[STREAM_INDICES].length;
+
+        for (int s = 0; s < STREAM_COUNT; s++) {
+            if (streams[s].length > 0)
+                memcpy(meshes->buffer + meshes->length, streams[s].data, streams[s].length);
+            meshes->length += streams[s].length;
+        }
+    }
+
+    meshes->num_meshes = (uint16_t)batch_count;
+
+    if (!add_nodes(meshes, gnodes, &scene, batches, batch_count)) {
+        fprintf(stderr, "GLB_Flatten : Error, out of memory\n");
+        goto end;
+    }
+
+    if (options->stats != NULL)
+        options->stats->bytes_copied += meshes->length;
+
+    status = 1;
+
+end:
+    for (int b = 0; b < batch_count; b++) {
+        for (int s = 0; s < STREAM_COUNT; s++)
+            free(batches[b].streams[s].data);
+    }
+
+    free(batches);
+    free_scene(&scene);
+
+    return status;
+}
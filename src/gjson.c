@@ -13,8 +13,9 @@
 #define can_access_at_index(buffer, index) ((buffer != NULL) && (((buffer)->offset + index) < (buffer)->length))
 #define cannot_access_at_index(buffer, index) (!can_access_at_index(buffer, index))
 
-#define gJSON_IsReference 255
+#define gJSON_IsReference 256
 #define GJSON_NESTING_LIMIT 100
+#define GJSON_INDEX_MIN 16
 
 typedef struct
 {
@@ -22,11 +23,35 @@ typedef struct
     size_t length;
     size_t offset;
     size_t depth;
+    bool lazy; /* nested objects and arrays are left for later */
 } parse_buffer;
 
 static bool parse_string(gJSON *item, parse_buffer *buffer);
 static bool parse_object(gJSON *item, parse_buffer *buffer);
 static bool parse_array(gJSON *item, parse_buffer *buffer);
+static bool parse_value(gJSON *item, parse_buffer *buffer);
+
+static bool expand_item(gJSON *item)
+{
+    /* builds the children of a lazy object or array, one level deep */
+
+    parse_buffer buffer = { 0, 0, 0, 0, true };
+
+    if (item == NULL || item->pending == NULL)
+        return true;
+
+    buffer.content = item->pending;
+    buffer.length = item->pending_length;
+    item->pending = NULL;
+
+    /* the text was checked by the lazy scan, only an allocation can fail */
+    if (parse_value(item, &buffer) == false) {
+        fprintf(stderr, "expand_item : Error, out of memory\n");
+        return false;
+    }
+
+    return true;
+}
 
 static unsigned char get_decimal_point(void)
 {
@@ -57,7 +82,7 @@ static gJSON *get_object_item(gJSON *object, const char *name, const bool case_s
 {
     gJSON *current_element = NULL;
 
-    if ((object == NULL) || (name == NULL))
+    if ((object == NULL) || (name == NULL) || !expand_item(object))
         return NULL;
 
     current_element = object->child;
@@ -74,13 +99,40 @@ static gJSON *get_object_item(gJSON *object, const char *name, const bool case_s
     return current_element;
 } 
 
+static bool index_items(gJSON *array)
+{
+    size_t count = 0;
+
+    for (gJSON *child = array->child; child != NULL; child = child->next)
+        count++;
+
+    array->items = (gJSON**) malloc(sizeof(gJSON*)*(count > 0 ? count : 1));
+    if (array->items == NULL)
+        return false;
+
+    count = 0;
+    for (gJSON *child = array->child; child != NULL; child = child->next)
+        array->items[count++] = child;
+    array->item_count = count;
+
+    return true;
+}
+
 static gJSON *get_array_item(gJSON *array, size_t index)
 {
     gJSON *current_child = NULL;
 
-    if (array == NULL)
+    if (array == NULL || !expand_item(array))
         return NULL;
 
+    /* accessors, bufferViews and nodes are looked up by index once per
+     * mesh, walking the list each time is quadratic in the file size */
+    if (array->items == NULL && index >= GJSON_INDEX_MIN)
+        index_items(array);
+
+    if (array->items != NULL)
+        return index < array->item_count ? array->items[index] : NULL;
+
     current_child = array->child;
     while ((current_child != NULL) && (index > 0)) {
         index--;
@@ -103,6 +155,25 @@ gJSON *gJSON_GetArrayItem(gJSON *array, int index)
     return get_array_item(array, (size_t) index);
 }
 
+size_t gJSON_CountNodes(gJSON *item, size_t *allocations)
+{
+    /* counts item, its siblings and their children. allocations also
+     * counts the strings owned by the nodes */
+    size_t count = 0;
+
+    for (; item != NULL; item = item->next) {
+        count++;
+
+        if (allocations != NULL)
+            *allocations += 1 + (item->string != NULL) + (item->valuestring != NULL) + (item->items != NULL);
+
+        if (item->child != NULL)
+            count += gJSON_CountNodes(item->child, allocations);
+    }
+
+    return count;
+}
+
 static gJSON *gJSON_New_Item(void)
 {
     gJSON *node = (gJSON*) malloc(sizeof(gJSON));
@@ -124,6 +195,10 @@ void gJSON_Delete(gJSON *item)
             gJSON_Delete(item->child);
         }
 
+        if (!(item->type & gJSON_IsReference))
+            free(item->valuestring);
+        free(item->items);
+        free(item->string);
         free(item);
         item = next;
     }
@@ -188,12 +263,22 @@ bool parse_string(gJSON *item, parse_buffer *buffer)
     return true;
 
 fail:
-   	printf("NOT A STRING\n");
+   	fprintf(stderr, "NOT A STRING\n");
 
     return false;
 }
 
-static bool parse_number(gJSON *item, parse_buffer *buffer)
+static int number_to_int(double number)
+{
+    if (number > INT_MAX)
+        return INT_MAX;
+    else if (number <= (double)INT_MIN)
+        return INT_MIN;
+
+    return (int)number;
+}
+
+static bool read_number(double *out, parse_buffer *buffer)
 {
     double number = 0;
     unsigned char *after_end = NULL;
@@ -245,22 +330,119 @@ loop_end:
     if (number_c_string == after_end)
         return false;
 
-    item->valuedouble = number;
+    *out = number;
 
-    if (number > INT_MAX)
-        item->valueint = INT_MAX;
-    else if (number <= (double)INT_MIN)
-        item->valueint = INT_MIN;
-    else
-        item->valueint = (int)number;
+    buffer->offset += (size_t)(after_end - number_c_string);
+    return true;
+}
+
+static bool parse_number(gJSON *item, parse_buffer *buffer)
+{
+    double number;
+
+    if (!read_number(&number, buffer))
+        return false;
 
+    item->valuedouble = number;
+    item->valueint = number_to_int(number);
     item->type = gJSON_Number;
 
-    buffer->offset += (size_t)(after_end - number_c_string);
     return true;
 }
 
 
+static bool skip_value(parse_buffer *buffer)
+{
+    /* checks one value with the grammar of parse_value without building
+     * it, so that a lazy parse fails on the same input as a full one */
+
+    const unsigned char *c = buffer_at_offset(buffer);
+    double number;
+
+    if (cannot_access_at_index(buffer, 0))
+        return false;
+
+    if (*c == '\"') {
+        for (size_t i = buffer->offset + 1; i < buffer->length; i++) {
+            if (buffer->content[i] == '\\')
+                i++;
+            else if (buffer->content[i] == '\"') {
+                buffer->offset = i + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (*c == '[' || *c == '{') {
+        unsigned char closing = *c == '[' ? ']' : '}';
+
+        if (buffer->depth >= GJSON_NESTING_LIMIT)
+            return false;
+
+        buffer->depth++;
+        buffer->offset++;
+
+        if (can_access_at_index(buffer, 0) && buffer_at_offset(buffer)[0] == closing) {
+            buffer->depth--;
+            buffer->offset++;
+            return true;
+        }
+
+        for (;;) {
+            if (closing == '}') {
+                if (cannot_access_at_index(buffer, 0) || buffer_at_offset(buffer)[0] != '\"' ||
+                    !skip_value(buffer) || cannot_access_at_index(buffer, 0) || buffer_at_offset(buffer)[0] != ':')
+                    return false;
+                buffer->offset++;
+            }
+
+            if (!skip_value(buffer) || cannot_access_at_index(buffer, 0))
+                return false;
+
+            if (buffer_at_offset(buffer)[0] == closing)
+                break;
+            if (buffer_at_offset(buffer)[0] != ',')
+                return false;
+            buffer->offset++;
+        }
+
+        buffer->depth--;
+        buffer->offset++;
+        return true;
+    }
+
+    if (*c == '-' || (*c >= '0' && *c <= '9'))
+        return read_number(&number, buffer);
+
+    if (can_read(buffer, 4) && (strncmp((const char*)c, "null", 4) == 0 || strncmp((const char*)c, "true", 4) == 0)) {
+        buffer->offset += 4;
+        return true;
+    }
+
+    if (can_read(buffer, 5) && strncmp((const char*)c, "false", 5) == 0) {
+        buffer->offset += 5;
+        return true;
+    }
+
+    return false;
+}
+
+static bool skip_container(gJSON *item, parse_buffer *buffer, int type)
+{
+    /* lazy objects and arrays, checked but only built on first access */
+
+    size_t start = buffer->offset;
+
+    if (!skip_value(buffer))
+        return false;
+
+    item->type = type;
+    item->pending = buffer->content + start;
+    item->pending_length = buffer->offset - start;
+    return true;
+}
+
 /* data creation function */
 static bool parse_value(gJSON* item, parse_buffer *buffer)
 {
@@ -300,12 +482,16 @@ static bool parse_value(gJSON* item, parse_buffer *buffer)
 
     /* array */
     if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] == '[')) {
+        if (buffer->lazy && buffer->depth > 0)
+            return skip_container(item, buffer, gJSON_Array);
         return parse_array(item, buffer);
     }
 
     /* object */
     if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] == '{'))
     {
+        if (buffer->lazy && buffer->depth > 0)
+            return skip_container(item, buffer, gJSON_Object);
         return parse_object(item, buffer);
     }
 
@@ -374,8 +560,9 @@ success:
     return true;
 
 fail:
+    gJSON_Delete(head);
 
-    printf("parse_array : failed\n");
+    fprintf(stderr, "parse_array : failed\n");
     return false;
 }
 
@@ -462,19 +649,21 @@ success:
     return true;
 
 fail:
+    gJSON_Delete(head);
+
     if (buffer->depth >= GJSON_NESTING_LIMIT) {
-        printf("parse_object : nesting limit exceeded %d. Aborting\n", GJSON_NESTING_LIMIT);
+        fprintf(stderr, "parse_object : nesting limit exceeded %d. Aborting\n", GJSON_NESTING_LIMIT);
     }
-    printf("parse_object : failed\n");
+    fprintf(stderr, "parse_object : failed\n");
 
     return false;
 }
 
 /* Creating Data */
 
-static gJSON *gJSON_ParseData(unsigned char *data, size_t length)
+static gJSON *gJSON_ParseData(const unsigned char *data, size_t length, bool lazy)
 {
-    parse_buffer buffer = { 0, 0, 0, 0 };
+    parse_buffer buffer = { 0, 0, 0, 0, lazy };
     gJSON *item = NULL;
 
     buffer.content = data;
@@ -497,7 +686,352 @@ fail:
     return NULL;
 }
 
-gJSON *gJSON_ParseWithLength(unsigned char *data, size_t length)
+gJSON *gJSON_ParseWithLength(const unsigned char *data, size_t length)
 {
-    return gJSON_ParseData(data, length);
+    return gJSON_ParseData(data, length, false);
+}
+
+gJSON *gJSON_ParseLazy(const unsigned char *data, size_t length)
+{
+    return gJSON_ParseData(data, length, true);
+}
+
+/* Tape */
+
+static uint32_t tape_push(gJSON_Tape *tape, int type, uint32_t key)
+{
+    if (tape->count == tape->capacity) {
+        uint32_t capacity = tape->capacity > 0 ? tape->capacity*2 : 256;
+        gJSON_TapeEntry *entries;
+
+        if (capacity > GJSON_TAPE_MAX_ENTRIES)
+            capacity = GJSON_TAPE_MAX_ENTRIES;
+        if (capacity <= tape->capacity)
+            return GJSON_TAPE_NONE;
+
+        entries = realloc(tape->entries, sizeof(gJSON_TapeEntry)*capacity);
+        if (entries == NULL)
+            return GJSON_TAPE_NONE;
+
+        tape->entries = entries;
+        tape->capacity = capacity;
+    }
+
+    gJSON_TapeEntry *entry = &tape->entries[tape->count];
+
+    memset(entry, 0, sizeof(gJSON_TapeEntry));
+    entry->type = (unsigned int)type;
+    entry->key = key;
+    entry->next = tape->count + 1;
+
+    return tape->count++;
+}
+
+static bool tape_skip_string(parse_buffer *buffer)
+{
+    /* leaves buffer after the closing quote */
+
+    if (cannot_access_at_index(buffer, 0) || buffer_at_offset(buffer)[0] != '\"')
+        return false;
+
+    for (size_t i = buffer->offset + 1; i < buffer->length; i++) {
+        if (buffer->content[i] == '\\') {
+            i++;
+        } else if (buffer->content[i] == '\"') {
+            buffer->offset = i + 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool tape_parse_value(gJSON_Tape *tape, parse_buffer *buffer, uint32_t key)
+{
+    uint32_t index;
+
+    if (cannot_access_at_index(buffer, 0))
+        return false;
+
+    switch (buffer_at_offset(buffer)[0]) {
+        case 'n':
+        case 't':
+        case 'f': {
+            static const char *literals[3] = { "null", "true", "false" };
+            static const int types[3] = { gJSON_Null, gJSON_True, gJSON_False };
+
+            for (int i = 0; i < 3; i++) {
+                size_t length = strlen(literals[i]);
+
+                if (can_read(buffer, length) && strncmp((const char*)buffer_at_offset(buffer), literals[i], length) == 0) {
+                    buffer->offset += length;
+                    return tape_push(tape, types[i], key) != GJSON_TAPE_NONE;
+                }
+            }
+
+            return false;
+        }
+
+        case '\"':
+            if ((index = tape_push(tape, gJSON_String, key)) == GJSON_TAPE_NONE)
+                return false;
+
+            tape->entries[index].value = (uint32_t)buffer->offset + 1;
+            return tape_skip_string(buffer);
+
+        case '[':
+        case '{':
+            break;
+
+        default: {
+            double number;
+
+            if (!read_number(&number, buffer))
+                return false;
+
+            /* most glTF numbers are indices and counts, kept in the entry */
+            if (number >= 0 && number < GJSON_TAPE_NONE && number == (double)(uint32_t)number) {
+                if ((index = tape_push(tape, GJSON_TAPE_INTEGER, key)) == GJSON_TAPE_NONE)
+                    return false;
+
+                tape->entries[index].value = (uint32_t)number;
+                return true;
+            }
+
+            if ((index = tape_push(tape, gJSON_Number, key)) == GJSON_TAPE_NONE)
+                return false;
+
+            if (tape->number_count == tape->number_capacity) {
+                uint32_t capacity = tape->number_capacity > 0 ? tape->number_capacity*2 : 64;
+                double *numbers = realloc(tape->numbers, sizeof(double)*capacity);
+
+                /* never more numbers than entries, capacity cannot wrap */
+                if (numbers == NULL)
+                    return false;
+
+                tape->numbers = numbers;
+                tape->number_capacity = capacity;
+            }
+
+            tape->entries[index].value = tape->number_count;
+            tape->numbers[tape->number_count++] = number;
+            return true;
+        }
+    }
+
+    /* objects and arrays, children then an end entry */
+    bool object = buffer_at_offset(buffer)[0] == '{';
+    unsigned char closing = object ? '}' : ']';
+    uint32_t children = 0;
+
+    if (buffer->depth >= GJSON_NESTING_LIMIT)
+        return false;
+
+    if ((index = tape_push(tape, object ? gJSON_Object : gJSON_Array, key)) == GJSON_TAPE_NONE)
+        return false;
+
+    buffer->depth++;
+    buffer->offset++;
+
+    if (can_access_at_index(buffer, 0) && buffer_at_offset(buffer)[0] != closing) {
+        buffer->offset--;
+
+        do {
+            uint32_t member = GJSON_TAPE_NONE;
+
+            buffer->offset++;
+
+            if (object) {
+                member = (uint32_t)buffer->offset + 1;
+
+                if (!tape_skip_string(buffer) || cannot_access_at_index(buffer, 0) ||
+                    buffer_at_offset(buffer)[0] != ':')
+                    return false;
+                buffer->offset++;
+            }
+
+            if (!tape_parse_value(tape, buffer, member))
+                return false;
+
+            children++;
+        } while (can_access_at_index(buffer, 0) && buffer_at_offset(buffer)[0] == ',');
+    }
+
+    if (cannot_access_at_index(buffer, 0) || buffer_at_offset(buffer)[0] != closing)
+        return false;
+
+    buffer->offset++;
+    buffer->depth--;
+
+    uint32_t end = tape_push(tape, GJSON_TAPE_END, GJSON_TAPE_NONE);
+    if (end == GJSON_TAPE_NONE)
+        return false;
+
+    tape->entries[end].value = index;
+    tape->entries[index].value = children;
+    tape->entries[index].next = end + 1;
+
+    return true;
+}
+
+int gJSON_TapeParse(gJSON_Tape *tape, const unsigned char *data, size_t length)
+{
+    /* same grammar as gJSON_ParseWithLength, 1 on success */
+
+    parse_buffer buffer = { 0, 0, 0, 0, false };
+
+    memset(tape, 0, sizeof(gJSON_Tape));
+
+    if (data == NULL || length >= GJSON_TAPE_NONE)
+        return 0;
+
+    tape->data = data;
+    tape->length = length;
+    buffer.content = data;
+    buffer.length = length;
+
+    if (!tape_parse_value(tape, &buffer, GJSON_TAPE_NONE)) {
+        fprintf(stderr, "gJSON_TapeParse : failed at %lu\n", (unsigned long)buffer.offset);
+        gJSON_TapeFree(tape);
+        return 0;
+    }
+
+    return 1;
+}
+
+void gJSON_TapeFree(gJSON_Tape *tape)
+{
+    free(tape->entries);
+    free(tape->numbers);
+    memset(tape, 0, sizeof(gJSON_Tape));
+}
+
+size_t gJSON_TapeSize(const gJSON_Tape *tape)
+{
+    /* bytes used, not counting the data */
+    return sizeof(gJSON_TapeEntry)*tape->count + sizeof(double)*tape->number_count;
+}
+
+uint32_t gJSON_TapeChild(const gJSON_Tape *tape, uint32_t index)
+{
+    if (index >= tape->count || (tape->entries[index].type != gJSON_Object && tape->entries[index].type != gJSON_Array))
+        return GJSON_TAPE_NONE;
+
+    return tape->entries[index + 1].type == GJSON_TAPE_END ? GJSON_TAPE_NONE : index + 1;
+}
+
+uint32_t gJSON_TapeNext(const gJSON_Tape *tape, uint32_t index)
+{
+    if (index >= tape->count || tape->entries[index].type == GJSON_TAPE_END)
+        return GJSON_TAPE_NONE;
+
+    uint32_t next = tape->entries[index].next;
+
+    return next < tape->count && tape->entries[next].type != GJSON_TAPE_END ? next : GJSON_TAPE_NONE;
+}
+
+uint32_t gJSON_TapeGetArrayItem(const gJSON_Tape *tape, uint32_t array, int item)
+{
+    uint32_t current = gJSON_TapeChild(tape, array);
+
+    if (item < 0)
+        return GJSON_TAPE_NONE;
+
+    /* containers are jumped over, never walked */
+    for (; current != GJSON_TAPE_NONE && item > 0; item--)
+        current = gJSON_TapeNext(tape, current);
+
+    return current;
+}
+
+static bool tape_key_equals(const gJSON_Tape *tape, uint32_t offset, const char *name)
+{
+    /* case insensitive like gJSON_GetObjectItem, on the raw key */
+
+    const unsigned char *key = tape->data + offset;
+    size_t left = tape->length - offset;
+    size_t i = 0;
+
+    for (; name[i] != '\0'; i++) {
+        if (i >= left || key[i] == '\"' || tolower(key[i]) != tolower((unsigned char)name[i]))
+            return false;
+
+        /* an escaped quote belongs to the key */
+        if (key[i] == '\\' && name[i + 1] != '\0') {
+            i++;
+            if (i >= left || key[i] != (unsigned char)name[i])
+                return false;
+        }
+    }
+
+    return i < left && key[i] == '\"';
+}
+
+uint32_t gJSON_TapeGetObjectItem(const gJSON_Tape *tape, uint32_t object, const char *name)
+{
+    if (name == NULL || object >= tape->count || tape->entries[object].type != gJSON_Object)
+        return GJSON_TAPE_NONE;
+
+    for (uint32_t current = gJSON_TapeChild(tape, object); current != GJSON_TAPE_NONE;
+         current = gJSON_TapeNext(tape, current)) {
+        if (tape_key_equals(tape, tape->entries[current].key, name))
+            return current;
+    }
+
+    return GJSON_TAPE_NONE;
+}
+
+int gJSON_TapeType(const gJSON_Tape *tape, uint32_t index)
+{
+    if (index >= tape->count)
+        return gJSON_Null;
+
+    return tape->entries[index].type == GJSON_TAPE_INTEGER ? gJSON_Number : (int)tape->entries[index].type;
+}
+
+double gJSON_TapeNumber(const gJSON_Tape *tape, uint32_t index)
+{
+    if (index < tape->count && tape->entries[index].type == GJSON_TAPE_INTEGER)
+        return tape->entries[index].value;
+
+    if (index >= tape->count || tape->entries[index].type != gJSON_Number)
+        return 0;
+
+    return tape->numbers[tape->entries[index].value];
+}
+
+int gJSON_TapeInt(const gJSON_Tape *tape, uint32_t index)
+{
+    return number_to_int(gJSON_TapeNumber(tape, index));
+}
+
+static const char *tape_text(const gJSON_Tape *tape, uint32_t offset, size_t *length)
+{
+    /* raw text up to the closing quote */
+
+    size_t end = offset;
+
+    while (end < tape->length && tape->data[end] != '\"')
+        end += tape->data[end] == '\\' ? 2 : 1;
+
+    if (length != NULL)
+        *length = end - offset;
+
+    return (const char*)tape->data + offset;
+}
+
+const char *gJSON_TapeString(const gJSON_Tape *tape, uint32_t index, size_t *length)
+{
+    if (index >= tape->count || tape->entries[index].type != gJSON_String)
+        return NULL;
+
+    return tape_text(tape, tape->entries[index].value, length);
+}
+
+const char *gJSON_TapeKey(const gJSON_Tape *tape, uint32_t index, size_t *length)
+{
+    if (index >= tape->count || tape->entries[index].key == GJSON_TAPE_NONE)
+        return NULL;
+
+    return tape_text(tape, tape->entries[index].key, length);
 }
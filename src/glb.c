@@ -7,10 +7,20 @@
 
 #include "glb.h"
 #include "gjson.h"
+#include "xxhash.h"
+#include "stats.h"
+#include "fgm.h"
+#include "anim.h"
+#include "bvh.h"
+#include "tangent.h"
+#include "flatten.h"
+#include "texture.h"
+#include "morph.h"
+#include "accessor.h"
 
 typedef struct
 {
-    unsigned char *data;
+    const unsigned char *data;
     uint32_t length;
 } GLB_Chunk;
 
@@ -18,360 +28,772 @@ typedef struct
 {
     int id;
 
-    /* buffer info*/
-    int byteLength;
-    int byteOffset;
+    /* where the elements are in the BIN chunk, stride 0 when they are packed */
+    uint64_t byteOffset;
+    uint64_t byteStride;
 
-    /*accessor info*/
+    /* bytes of the stream, count elements of element_size bytes */
+    uint64_t byteLength;
     int count;
-    int data_size;
-    int group_count;
+    int element_size;
 } GLB_Attribute;
 
-int buffer_position;
+/* attributes of a mesh in the order of the FGM buffer */
+enum
+{
+    GLB_ATTRIB_POSITION,
+    GLB_ATTRIB_NORMAL,
+    GLB_ATTRIB_TEXCOORD,
+    GLB_ATTRIB_INDICES,
+    GLB_ATTRIB_COUNT,
+};
 
-static char SIGN_BE[5] = {0x46, 0x54, 0x6C, 0x67}; /* big endian for ARM */
-static char SIGN_LE[5] = {0x67, 0x6C, 0x54, 0x46}; /* little endian for x86 */
+static const char SIGN_BE[5] = {0x46, 0x54, 0x6C, 0x67}; /* big endian for ARM */
+static const char SIGN_LE[5] = {0x67, 0x6C, 0x54, 0x46}; /* little endian for x86 */
 
-static void set_accessor(GLB_Attribute *attrib, gJSON *target)
+static int resolve_attribute(GLB_Attribute *attrib, gJSON *gson, const GLB_Chunk *bin)
 {
-    /* setting accessor values, 'componentType` will be used
-     * to define data_size */
-
-    attrib->count = gJSON_GetObjectItem(target, "count")->valueint;
-    int componentType = gJSON_GetObjectItem(target, "componentType")->valueint;
-    char *type = gJSON_GetObjectItem(target, "type")->valuestring;
-
-    switch (componentType) {
-        case 5125: /* unsigned int */
-        case 5126: /* float */
-            attrib->data_size = sizeof(float);
-            break;
-        case 5122: /* signed short */
-        case 5123: /* unsigned short */
-            attrib->data_size = sizeof(signed short);
-            break;
-        case 5121: /* unsigned byte */
-        case 5120: /* signed byte */
-        default:
-            attrib->data_size = sizeof(unsigned char);
-            break;
-    }
-
-    /* Defining the numbers in group */
-    if (strncmp(type, "SCALAR", 6) == 0) {
-        attrib->group_count = 1;
-    } else if (strncmp(type,"VEC2", 4) == 0) {
-        attrib->group_count = 2;
-    } else if (strncmp(type, "VEC3", 4) == 0) {
-        attrib->group_count = 3;
-    } else if (strncmp(type, "VEC4", 4) == 0) {
-        attrib->group_count = 4;
-    } else if (strncmp(type, "MAT2", 4) == 0) {
-        attrib->group_count = 4;
-    } else if (strncmp(type, "MAT3", 4) == 0) {
-        attrib->group_count = 9;
-    } else if (strncmp(type, "MAT4", 4) == 0) {
-        attrib->group_count = 16;
-    } else {
-        attrib->group_count = 1;
-    }
+    /* fills attrib from its accessor, only its elements are copied. Sparse
+     * accessors and accessors without a bufferView are not raw bytes */
+
+    GLB_Accessor accessor;
 
-    free(type);
+    if (!GLB_GetAccessorRange(&accessor, gson, attrib->id, bin->length, &attrib->byteOffset))
+        return 0;
+
+    attrib->count = accessor.count;
+    attrib->element_size = accessor.component_size*accessor.components;
+    attrib->byteLength = (uint64_t)accessor.count*attrib->element_size;
+    attrib->byteStride = accessor.stride != (size_t)attrib->element_size ? accessor.stride : 0;
+
+    return 1;
 }
 
-static void set_bufferview(GLB_Attribute *bf, gJSON *source)
+static int resolve_mesh(GLB_Attribute attribs[GLB_ATTRIB_COUNT], uint16_t index, gJSON *gson, const GLB_Chunk *bin)
 {
-    bf->byteLength = gJSON_GetObjectItem(source, "byteLength")->valueint;
-    bf->byteOffset = gJSON_GetObjectItem(source, "byteOffset")->valueint;
+    /* resolves the attributes of mesh index in FGM order */
+
+    gJSON *gmesh = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "meshes"), index);
+    gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gmesh, "primitives"), 0);
+    gJSON *gattr = gJSON_GetObjectItem(gprim, "attributes");
+
+    gJSON *sources[GLB_ATTRIB_COUNT] = {
+        gJSON_GetObjectItem(gattr, "POSITION"),
+        gJSON_GetObjectItem(gattr, "NORMAL"),
+        gJSON_GetObjectItem(gattr, "TEXCOORD_0"),
+        gJSON_GetObjectItem(gprim, "indices"),
+    };
+
+    for (int i = 0; i < GLB_ATTRIB_COUNT; i++) {
+        if (sources[i] == NULL) {
+            fprintf(stderr, "get_mesh : Error, mesh %d needs POSITION, NORMAL, TEXCOORD_0 and indices\n", index);
+            return 0;
+        }
+
+        attribs[i].id = sources[i]->valueint;
+
+        if (!resolve_attribute(&attribs[i], gson, bin)) {
+            fprintf(stderr, "get_mesh : Error, mesh %d has an invalid accessor\n", index);
+            return 0;
+        }
+    }
+
+    return 1;
 }
 
-static void *read_buffer(GLB_Attribute mattr, unsigned char* bin_data)
+static int get_mesh(struct GLB_Meshes *meshes, uint16_t index, gJSON *gson, const GLB_Chunk *bin,
+                    const struct GLB_Options *options, struct GLB_Range *sources)
 {
-    /* function that grabs copiesthe byte data then return a void pointer
-     * that can be converted to the attribute data_type */
+    /* process mesh attribute identified by index, appending it to meshes,
+     * sources (optional) receives where each stream was in the BIN chunk */
+
+    struct ConvertStats *stats = options->stats;
+    GLB_Attribute attribs[GLB_ATTRIB_COUNT];
+    StatsClock clock;
+
+    FGM_StatsStart(&clock);
+    int resolved = resolve_mesh(attribs, index, gson, bin);
+    FGM_StatsStop(stats, FGM_STAGE_ACCESSORS, &clock);
+
+    if (!resolved)
+        return 0;
 
-    /*unsigned char a_buffer[mattr.byteLength]; */
-    unsigned char *a_buffer = malloc(mattr.byteLength);
-    memcpy(a_buffer, bin_data+mattr.byteOffset, mattr.byteLength);
+    for (int i = 0; sources != NULL && i < GLB_ATTRIB_COUNT; i++) {
+        sources[i].offset = attribs[i].byteOffset;
+        sources[i].length = attribs[i].byteLength;
+        sources[i].stride = attribs[i].byteStride;
+        sources[i].element_size = (uint32_t)attribs[i].element_size;
+    }
+
+    FGM_StatsStart(&clock);
+
+    size_t mesh_size = 0;
+    for (int i = 0; i < GLB_ATTRIB_COUNT; i++)
+        mesh_size += (size_t)attribs[i].byteLength;
 
-    int groupSize = mattr.group_count * mattr.data_size;
-    void *buffer = malloc(mattr.data_size * mattr.group_count * mattr.count);
+    size_t position = meshes->length;
+    unsigned char *buffer = realloc(meshes->buffer, position + mesh_size);
 
-    void *dGroup = malloc(mattr.data_size);
+    if (buffer == NULL)
+        return 0;
+    meshes->buffer = buffer;
 
-    for (int i = 0; i < mattr.count; i++) {
-        int index = i*groupSize;
+    /* elements are copied as they are, has to be in this order check format file.
+     * Interleaved ones are gathered */
+    size_t offset = position;
 
-        for (int j = 0; j < mattr.group_count; j++) {
-            memcpy(dGroup, a_buffer + index + mattr.data_size*j, mattr.data_size);
-            memcpy(buffer+index + mattr.data_size*j, dGroup, mattr.data_size);
+    for (int i = 0; i < GLB_ATTRIB_COUNT; i++) {
+        const unsigned char *source = bin->data + attribs[i].byteOffset;
+
+        if (attribs[i].byteStride == 0) {
+            memcpy(buffer + offset, source, (size_t)attribs[i].byteLength);
+        } else {
+            for (int e = 0; e < attribs[i].count; e++)
+                memcpy(buffer + offset + (size_t)e*attribs[i].element_size, source + attribs[i].byteStride*e,
+                       attribs[i].element_size);
         }
 
+        offset += (size_t)attribs[i].byteLength;
     }
-    free(dGroup);
 
-    return buffer;
+    meshes->length = position + mesh_size;
+
+    struct BufferSizes *sizes = realloc(meshes->sizes, sizeof(struct BufferSizes)*(index+1));
 
+    if (sizes == NULL)
+        return 0;
+    meshes->sizes = sizes;
+
+    meshes->sizes[index].position = attribs[GLB_ATTRIB_POSITION].byteLength;
+    meshes->sizes[index].normals = attribs[GLB_ATTRIB_NORMAL].byteLength;
+    meshes->sizes[index].texcoords = attribs[GLB_ATTRIB_TEXCOORD].byteLength;
+    meshes->sizes[index].indices = attribs[GLB_ATTRIB_INDICES].byteLength;
+
+    meshes->num_meshes = index + 1;
+
+    if (stats != NULL)
+        stats->bytes_copied += mesh_size;
+
+    FGM_StatsStop(stats, FGM_STAGE_EXTRACT, &clock);
+
+    return 1;
 }
 
-static unsigned char *get_mesh(unsigned char *buffer, struct BufferSizes **sizes, uint16_t index, gJSON *gson, 
-                               unsigned char* bin_data)
+static int get_mesh_from_gjson(struct GLB_Meshes *meshes, gJSON *gson, const GLB_Chunk *bin,
+                               const struct GLB_Options *options, struct GLB_Range **sources)
 {
-    /* process mesh attribute identified by index */
+    /* JSON setup */
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    gJSON *g_curr = gJSON_GetArrayItem(gmeshes, 0);
+    uint16_t index = 0;
 
-    gJSON *gmesh = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "meshes"), index);
-    gJSON *gprim = gJSON_GetObjectItem(gmesh, "primitives")->child;
-    gJSON *gattr = gJSON_GetObjectItem(gprim, "attributes");
+    if (g_curr == NULL) {
+        fprintf(stderr, "get_mesh_from_gjson : Error, no meshes!\n");
+        return 0;
+    }
+
+    /* iterating through every elements in mesh */
+    for (; g_curr != NULL; g_curr = g_curr->next) {
+        if (index == UINT16_MAX) {
+            fprintf(stderr, "get_mesh_from_gjson : Error, more than %d meshes\n", UINT16_MAX);
+            return 0;
+        }
 
-    /* attributes */
-    GLB_Attribute mesh_Position, mesh_Normal, mesh_Indices, mesh_Texcoord;
+        if (sources != NULL) {
+            struct GLB_Range *grown = realloc(*sources, sizeof(struct GLB_Range)*GLB_ATTRIB_COUNT*(index + 1));
+            if (grown == NULL)
+                return 0;
+            *sources = grown;
+        }
 
-    mesh_Position.id = gJSON_GetObjectItem(gattr, "POSITION")->valueint;
-    mesh_Indices.id = gJSON_GetObjectItem(gprim, "indices")->valueint;
-    mesh_Normal.id = gJSON_GetObjectItem(gattr, "NORMAL")->valueint;
-    mesh_Texcoord.id = gJSON_GetObjectItem(gattr, "TEXCOORD_0")->valueint;
+        if (!get_mesh(meshes, index, gson, bin, options, sources != NULL ? *sources + index*GLB_ATTRIB_COUNT : NULL))
+            return 0;
 
-    /* accessors, setting values */
-    gJSON *access = gJSON_GetObjectItem(gson, "accessors");
+        index++;
+    }
 
-    set_accessor(&mesh_Position, gJSON_GetArrayItem(access, mesh_Position.id));
-    set_accessor(&mesh_Indices, gJSON_GetArrayItem(access, mesh_Indices.id));
-    set_accessor(&mesh_Normal, gJSON_GetArrayItem(access, mesh_Normal.id));
-    set_accessor(&mesh_Texcoord, gJSON_GetArrayItem(access, mesh_Texcoord.id));
+    return 1;
+}
 
-    /* bufferviews */
-    gJSON *bufferViews = gJSON_GetObjectItem(gson, "bufferViews");
+static int read_chunk(GLB_Chunk *chunk, const unsigned char *data, size_t length, size_t *offset,
+                      uint32_t type)
+{
+    /* chunk header is the data length then its type, data follows */
 
-    set_bufferview(&mesh_Position, gJSON_GetArrayItem(bufferViews, mesh_Position.id));
-    set_bufferview(&mesh_Indices, gJSON_GetArrayItem(bufferViews, mesh_Indices.id));
-    set_bufferview(&mesh_Normal, gJSON_GetArrayItem(bufferViews, mesh_Normal.id));
-    set_bufferview(&mesh_Texcoord, gJSON_GetArrayItem(bufferViews, mesh_Texcoord.id));
+    uint32_t chunk_type;
 
-    /* setting up buffer data*/
-    float* vertices =           (float*)read_buffer(mesh_Position, bin_data);
-    unsigned short* indices =   (unsigned short*)read_buffer(mesh_Indices, bin_data);
-    float* normals =            (float*)read_buffer(mesh_Normal, bin_data);
-    float* texcoords =         (float*)read_buffer(mesh_Texcoord, bin_data);
-    int buffer_size = mesh_Position.byteLength + mesh_Normal.byteLength + mesh_Texcoord.byteLength + 
-                        mesh_Indices.byteLength + buffer_position;
+    if (length - *offset < 8)
+        return 0;
 
-    buffer = realloc(buffer, buffer_size);
+    memcpy(&chunk->length, data + *offset, 4);
+    memcpy(&chunk_type, data + *offset + 4, 4);
+    *offset += 8;
 
-    /* has to be in this order check format file */
-    memcpy(buffer + buffer_position, vertices, mesh_Position.byteLength);
-    memcpy(buffer + buffer_position + mesh_Position.byteLength, normals, mesh_Normal.byteLength);
+    if (chunk_type != type || chunk->length > length - *offset)
+        return 0;
 
-    memcpy(buffer + buffer_position + mesh_Position.byteLength + mesh_Normal.byteLength, texcoords, 
-            mesh_Texcoord.byteLength);
+    chunk->data = data + *offset;
+    *offset += chunk->length;
 
-    memcpy(buffer + buffer_position + mesh_Position.byteLength + mesh_Normal.byteLength + 
-            mesh_Texcoord.byteLength, indices, mesh_Indices.byteLength);
+    return 1;
+}
 
-    buffer_position = buffer_size;
+static uint64_t share_key(const struct GLB_Range *source, const unsigned char *data, uint64_t length,
+                          int by_content)
+{
+    if (by_content)
+        return XXH64(data, length, length);
 
-    if (sizes == NULL)
-        *sizes = malloc(sizeof(struct BufferSizes));
-    else
-        *sizes = realloc(*sizes, sizeof(struct BufferSizes)*(index+1));
+    uint64_t range[4] = { source->offset, source->length, source->stride, source->element_size };
+    return XXH64(range, sizeof(range), 0);
+}
 
+static int share_streams(struct GLB_Meshes *meshes, const struct GLB_Range *sources, uint32_t flags)
+{
+    /* writes every distinct stream once and adds the STRM section giving
+     * the offset of each mesh stream in the buffer. Streams are the same
+     * when they read the same elements of the BIN chunk (sources, NULL
+     * for flattened meshes) or, with GLB_FLAG_SHARE_CONTENT, when their
+     * bytes are equal */
+
+    int stream_count = meshes->num_meshes*GLB_ATTRIB_COUNT;
+    size_t table_size = 16;
+    int status = 0;
+
+    while (table_size < (size_t)stream_count*2)
+        table_size *= 2;
+
+    /* open addressing on the key, entries are stream index + 1 */
+    int *tables[2] = { calloc(table_size, sizeof(int)), calloc(table_size, sizeof(int)) };
+    uint64_t *offsets = malloc(sizeof(uint64_t)*(stream_count > 0 ? stream_count : 1));
+    uint64_t *starts = malloc(sizeof(uint64_t)*(stream_count > 0 ? stream_count : 1));
+    unsigned char *buffer = malloc(meshes->length > 0 ? meshes->length : 1);
+    size_t length = 0, position = 0;
+    uint32_t unique = 0;
+    FGM_Bytes bytes = { 0 };
+
+    if (tables[0] == NULL || tables[1] == NULL || offsets == NULL || starts == NULL || buffer == NULL)
+        goto end;
+
+    /* where each stream is in the unshared buffer */
+    for (int s = 0; s < stream_count; s++) {
+        const uint64_t *sizes = &meshes->sizes[s / GLB_ATTRIB_COUNT].position;
+
+        starts[s] = position;
+        position += sizes[s % GLB_ATTRIB_COUNT];
+    }
 
+    for (int s = 0; s < stream_count; s++) {
+        const uint64_t *sizes = &meshes->sizes[s / GLB_ATTRIB_COUNT].position;
+        uint64_t size = sizes[s % GLB_ATTRIB_COUNT];
+        const unsigned char *data = meshes->buffer + starts[s];
+        int shared = -1;
 
-    (*sizes)[index].position = mesh_Position.byteLength;
-    (*sizes)[index].normals = mesh_Normal.byteLength;
-    (*sizes)[index].texcoords = mesh_Texcoord.byteLength;
-    (*sizes)[index].indices = mesh_Indices.byteLength;
+        for (int mode = 0; shared < 0 && mode < 2; mode++) {
+            if ((mode == 0 && sources == NULL) || (mode == 1 && !(flags & GLB_FLAG_SHARE_CONTENT)))
+                continue;
 
+            size_t slot = (size_t)share_key(sources != NULL ? sources + s : NULL, data, size, mode) & (table_size - 1);
 
-    return buffer;
+            for (; tables[mode][slot] != 0; slot = (slot + 1) & (table_size - 1)) {
+                int other = tables[mode][slot] - 1;
+                const uint64_t *other_sizes = &meshes->sizes[other / GLB_ATTRIB_COUNT].position;
+
+                if (other_sizes[other % GLB_ATTRIB_COUNT] != size)
+                    continue;
+
+                if (mode == 0 ? (sources[other].offset == sources[s].offset && sources[other].length == size &&
+                                 sources[other].stride == sources[s].stride &&
+                                 sources[other].element_size == sources[s].element_size) :
+                                memcmp(meshes->buffer + starts[other], data, size) == 0) {
+                    shared = other;
+                    break;
+                }
+            }
+
+            if (shared < 0)
+                tables[mode][slot] = s + 1;
+        }
+
+        if (shared >= 0) {
+            offsets[s] = offsets[shared];
+            continue;
+        }
+
+        if (size > 0)
+            memcpy(buffer + length, data, size);
+
+        offsets[s] = length;
+        length += size;
+        unique++;
+    }
+
+    /* mesh count, distinct streams, buffer length then 4 offsets per mesh */
+    uint32_t header[2] = { meshes->num_meshes, unique };
+    uint64_t buffer_length = length;
+
+    FGM_BytesAppend(&bytes, header, sizeof(header));
+    FGM_BytesAppend(&bytes, &buffer_length, sizeof(uint64_t));
+    FGM_BytesAppend(&bytes, offsets, sizeof(uint64_t)*stream_count);
+
+    if (!FGM_AddSection(meshes, FGM_SECTION_STREAMS, &bytes))
+        goto end;
+
+    free(meshes->buffer);
+    meshes->buffer = buffer;
+    meshes->length = length;
+    buffer = NULL;
+    status = 1;
+
+end:
+    free(tables[0]);
+    free(tables[1]);
+    free(offsets);
+    free(starts);
+    free(buffer);
+
+    return status;
 }
 
-static unsigned char *get_mesh_from_gjson(uint16_t *num_meshes, struct BufferSizes **sizes, gJSON *gson, 
-                                          unsigned char* bin_data)
+static void hash_accessor(XXH64_State *state, gJSON *item, gJSON *gson, const GLB_Chunk *bin)
 {
-    /*
-    RNDR_Object *m_head = NULL;
-    RNDR_Object *m_curr = NULL;
-    */
+    /* the layout and values of an accessor, sparse substitutions included,
+     * not its index so that reordering accessors keeps the hash */
 
-    /* iterating through meshes */
-    /*
-    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    GLB_Accessor accessor;
+    int32_t layout[6] = { -1, 0, 0, 0, 0, 0 };
 
-    gJSON *g_curr = gmeshes->child;
-    gJSON *g_next = NULL;
+    if (item == NULL || !GLB_GetAccessor(&accessor, gson, item->valueint, bin->data, bin->length)) {
+        XXH64_Update(state, layout, sizeof(layout));
+        return;
+    }
 
-    if (g_curr == NULL) {
-        printf("get_mesh_from_gjson : Error, no meshes!\n");
-        goto fail;
+    size_t element = (size_t)accessor.component_size*accessor.components;
+    size_t index_size = accessor.sparse_index_type == 5121 ? 1 : accessor.sparse_index_type == 5123 ? 2 : 4;
+
+    layout[0] = accessor.count;
+    layout[1] = accessor.components;
+    layout[2] = accessor.component_type;
+    layout[3] = accessor.normalized;
+    layout[4] = accessor.sparse_count;
+    layout[5] = accessor.sparse_index_type;
+    XXH64_Update(state, layout, sizeof(layout));
+
+    if (accessor.data != NULL && accessor.stride == element) {
+        XXH64_Update(state, accessor.data, element*(size_t)accessor.count);
+    } else {
+        for (int i = 0; accessor.data != NULL && i < accessor.count; i++)
+            XXH64_Update(state, accessor.data + (size_t)i*accessor.stride, element);
     }
 
-    int index = 0;
-    do {
-       
-        if (m_head == NULL)
-        {
-            m_curr = m_head = get_mesh(index, gson, bin_data);
-        } else{
-            RNDR_Object *new = get_mesh(index, gson, bin_data);
-            m_curr->next = new;
-            m_curr->prev = m_curr;
-            m_curr = new;
-        }
-    */
-        /* iterating through every elements in
-         * mesh */
+    if (accessor.sparse_count > 0) {
+        XXH64_Update(state, accessor.sparse_indices, index_size*(size_t)accessor.sparse_count);
+        XXH64_Update(state, accessor.sparse_values, element*(size_t)accessor.sparse_count);
+    }
+}
 
-    /*
-        g_next = g_curr->next;
-        g_curr = g_next;
-        g_next = NULL;
+static int hash_meshes(struct GLB_Meshes *meshes, gJSON *gson, const GLB_Chunk *bin)
+{
+    /* GLB_Meshes.hashes, from everything the GLB_FLAGS_REUSED sections read
+     * of a mesh : the mode and attributes of its first primitive */
 
-        index++;
-    
-    } while (g_curr != NULL);
+    static const char *attributes[4] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+    gJSON *gmesh = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "meshes"), 0);
 
+    meshes->hashes = malloc(sizeof(uint64_t)*(meshes->num_meshes > 0 ? meshes->num_meshes : 1));
+    if (meshes->hashes == NULL)
+        return 0;
 
-    gJSON_Delete(gmeshes);
-    return m_head;
-fail:
-    gJSON_Delete(gmeshes);
+    for (int m = 0; m < meshes->num_meshes && gmesh != NULL; m++, gmesh = gmesh->next) {
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gmesh, "primitives"), 0);
+        gJSON *gattr = gJSON_GetObjectItem(gprim, "attributes");
+        gJSON *gmode = gJSON_GetObjectItem(gprim, "mode");
+        int32_t mode = gmode != NULL ? gmode->valueint : 4;
+        XXH64_State state;
 
-    return NULL;
-    */
-    unsigned char *buffer = NULL;
+        XXH64_Init(&state, 0);
+        XXH64_Update(&state, &mode, sizeof(mode));
 
+        for (int i = 0; i < 4; i++)
+            hash_accessor(&state, gJSON_GetObjectItem(gattr, attributes[i]), gson, bin);
+        hash_accessor(&state, gJSON_GetObjectItem(gprim, "indices"), gson, bin);
 
-    /* JSON setup */
-    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+        meshes->hashes[m] = XXH64_Digest(&state);
+    }
 
-    gJSON *g_curr = gmeshes->child;
-    gJSON *g_next = NULL;
-    buffer_position = 0;
+    return 1;
+}
 
-    if (g_curr == NULL) {
-        printf("get_mesh_from_gjson : Error, no meshes!\n");
-        goto fail;
+typedef struct
+{
+    uint64_t hash;
+    int mesh;
+} MeshHash;
+
+static int compare_hashes(const void *a, const void *b)
+{
+    const MeshHash *ha = a, *hb = b;
+
+    return (ha->hash > hb->hash) - (ha->hash < hb->hash);
+}
+
+static int *map_previous(const struct GLB_Meshes *meshes, const struct GLB_Previous *previous)
+{
+    /* FGM_Reuse.previous, meshes are matched anywhere in the previous
+     * output so adding or reordering meshes keeps the others. NULL when
+     * there is nothing to reuse, everything is then built */
+
+    int *map;
+    MeshHash *sorted;
+
+    if (previous == NULL || previous->hashes == NULL || previous->num_meshes <= 0 || meshes->hashes == NULL)
+        return NULL;
+
+    map = malloc(sizeof(int)*(meshes->num_meshes > 0 ? meshes->num_meshes : 1));
+    sorted = malloc(sizeof(MeshHash)*previous->num_meshes);
+
+    if (map == NULL || sorted == NULL) {
+        free(map);
+        free(sorted);
+        return NULL;
     }
 
-    do {
+    for (int i = 0; i < previous->num_meshes; i++) {
+        sorted[i].hash = previous->hashes[i];
+        sorted[i].mesh = i;
+    }
 
-        /*
-        if (buffer == NULL)
-        {
-            buffer = get_mesh(num_meshes, gson, bin_data);
-        } else{
-            RNDR_Object *new = get_mesh(num_meshes, gson, bin_data);
-            m_curr->next = new;
-            m_curr->prev = m_curr;
-            m_curr = new;
-        }
-        */
+    qsort(sorted, previous->num_meshes, sizeof(MeshHash), compare_hashes);
 
-        buffer = get_mesh(buffer, sizes, *num_meshes, gson, bin_data);
-        /* iterating through every elements in
-         * mesh */
+    for (int m = 0; m < meshes->num_meshes; m++) {
+        MeshHash key = { meshes->hashes[m], 0 };
+        MeshHash *found = bsearch(&key, sorted, previous->num_meshes, sizeof(MeshHash), compare_hashes);
 
-        g_next = g_curr->next;
-        g_curr = g_next;
-        g_next = NULL;
+        map[m] = found != NULL ? found->mesh : -1;
+    }
+
+    free(sorted);
+    return map;
+}
 
-        *num_meshes = *num_meshes + 1;
+static FGM_Reuse *find_reuse(FGM_Reuse *reuse, const struct GLB_Previous *previous, const char *tag)
+{
+    /* reuse pointed at the section tag of the previous output, NULL when
+     * there is nothing to copy from */
 
-    } while (g_curr != NULL);
+    if (reuse->previous == NULL)
+        return NULL;
 
+    reuse->section = FGM_FindSection(previous->fgm, previous->length, tag, &reuse->length);
+    return reuse->section != NULL ? reuse : NULL;
+}
 
-    gJSON_Delete(gmeshes);
-    return buffer;
-fail:
-    gJSON_Delete(gmeshes);
-    return NULL;
+static int build_sections(struct GLB_Meshes *meshes, gJSON *gson, const GLB_Chunk *bin,
+                          const struct GLB_Options *options)
+{
+    /* optional sections following the mesh buffer, in flag order */
+
+    FGM_Bytes bytes = { 0 };
+    int *previous = map_previous(meshes, options->previous);
+    FGM_Reuse reuse = { NULL, 0, previous, 0 };
+    int status = 0;
+
+    if (options->flags & GLB_FLAG_SKIN) {
+        if (!FGM_BuildSkins(&bytes, gson, bin->data, bin->length, meshes->num_meshes) ||
+            !FGM_AddSection(meshes, FGM_SECTION_SKIN, &bytes))
+            goto end;
+    }
+
+    if (options->flags & GLB_FLAG_ANIM) {
+        int fps = options->anim_fps > 0 ? options->anim_fps : GLB_DEFAULT_ANIM_FPS;
+
+        if (!FGM_BuildAnimations(&bytes, gson, bin->data, bin->length, fps) ||
+            !FGM_AddSection(meshes, FGM_SECTION_ANIM, &bytes))
+            goto end;
+    }
+
+    if (options->flags & GLB_FLAG_BVH) {
+        if (!FGM_BuildBVH(&bytes, gson, bin->data, bin->length, meshes->num_meshes, options->threads,
+                          find_reuse(&reuse, options->previous, FGM_SECTION_BVH)) ||
+            !FGM_AddSection(meshes, FGM_SECTION_BVH, &bytes))
+            goto end;
+    }
+
+    if (options->flags & GLB_FLAG_TANGENTS) {
+        if (!FGM_BuildTangents(&bytes, gson, bin->data, bin->length, meshes->num_meshes,
+                               find_reuse(&reuse, options->previous, FGM_SECTION_TANGENTS)) ||
+            !FGM_AddSection(meshes, FGM_SECTION_TANGENTS, &bytes))
+            goto end;
+    }
+
+    if (options->flags & GLB_FLAG_TEXTURES) {
+        if (!FGM_BuildTextures(&bytes, gson, bin->data, bin->length) ||
+            !FGM_AddSection(meshes, FGM_SECTION_TEXTURES, &bytes))
+            goto end;
+    }
+
+    if (options->flags & GLB_FLAG_MORPH) {
+        if (!FGM_BuildMorphs(&bytes, gson, bin->data, bin->length, meshes->num_meshes) ||
+            !FGM_AddSection(meshes, FGM_SECTION_MORPH, &bytes))
+            goto end;
+    }
+
+    status = 1;
+
+end:
+    if (options->stats != NULL)
+        options->stats->sections_reused += (uint64_t)reuse.reused;
+
+    free(bytes.data);
+    free(previous);
+
+    return status;
 }
 
-static unsigned char *read_glb(uint16_t *num_meshes, struct BufferSizes **sizes, const char*path)
+static int read_glb(struct GLB_Meshes *meshes, const unsigned char *data, size_t length,
+                    const struct GLB_Options *options)
 {
     /* there should only be 2 chunks in the GLB file,
      * JSON (mandatory) and BIN (chunk) optional but mandatory
-     * for this decoder*/
+     * for this decoder. The chunks are used in place, nothing
+     * in data is copied or modified */
 
     /* reading the header */
 
-    FILE *fp;
-    char sign[5];
-    char log[215];
-    uint32_t version, size; /* version must be 2 and size is the file size */
+    const char *log;
+    size_t offset = 12;
+    StatsClock clock;
+
+    memset(meshes, 0, sizeof(struct GLB_Meshes));
 
-    if ((fp = fopen(path, "rb")) == NULL) {
-        strcpy(log, "read_glb [Error] : could not open file");
+    if (data == NULL || length < 12) {
+        log = "read_glb [Error] : header too short";
         goto fail;
     }
 
-    if (fread(sign, 1, 4, fp) != 4) {
-        strcpy(log, "read_glb [Error] : signature length too hight");
+    if (!GLB_CheckHeader(data)) {
+        log = "read_glb [Error] : open failed, possible reason version != 2, bad signature";
         goto fail;
     }
 
-    if (fread(&version, 4, 1, fp) != 1) {
-        strcpy(log, "read_glb [Error] : version cannot be read");
+    /* reading chunks JSON is the first chunk */
+    GLB_Chunk json_chunk, bin_chunk;
+
+    if (!read_chunk(&json_chunk, data, length, &offset, GLB_CHUNK_JSON)) {
+        log = "read_chunk : could not read json chunk";
         goto fail;
     }
 
-    if (fread(&size, 4, 1, fp) != 1) {
-        strcpy(log, "read_glb [ERROR] : could not read file size");
+    if (!read_chunk(&bin_chunk, data, length, &offset, GLB_CHUNK_BIN)) {
+        log = "read_chunk : could not read bin chunk";
         goto fail;
     }
 
-    if (version != 2 || (strncmp(sign, SIGN_BE, 4) != 0 &&
-        strncmp(sign, SIGN_LE, 4)) != 0) {
-        strcpy(log, "read_glb [Error] : open failed, possible reason version != 2, bad signature");
+    if ((options->flags & GLB_FLAG_FLATTEN) && (options->flags & GLB_FLAGS_PER_MESH)) {
+        log = "read_glb [Error] : flattening can not be combined with per mesh sections";
         goto fail;
     }
 
-    /* reading chunks JSON is the first chunk */
-    GLB_Chunk json_chunk, bin_chunk;
-
-    char chunk_type[5];
-    chunk_type[4] = '\0';
+    /* decoding */
+    FGM_StatsStart(&clock);
+    gJSON *gson = gJSON_ParseLazy(json_chunk.data, json_chunk.length);
+    FGM_StatsStop(options->stats, FGM_STAGE_PARSE, &clock);
 
-    if (fread(&json_chunk.length, 4, 1, fp) != 1) {
-        printf("read_chunk : could not read json chunk\n");
+    if (gson == NULL) {
+        log = "read_glb [Error] : could not parse json chunk";
         goto fail;
     }
 
-    fread(chunk_type, 4, 1, fp); /* skipping type */
-    json_chunk.data = malloc(sizeof(unsigned char)*json_chunk.length);
-    fread(json_chunk.data, json_chunk.length, 1, fp);
+    int decoded;
 
-    if (fread(&bin_chunk.length, 4, 1, fp) != 1) {
-        printf("read_chunk : could not read bin chunk\n");
-        goto fail;
+    int share = (options->flags & GLB_FLAGS_SHARE) != 0;
+    struct GLB_Range *sources = NULL;
+
+    if (options->flags & GLB_FLAG_FLATTEN) {
+        FGM_StatsStart(&clock);
+        decoded = GLB_Flatten(meshes, gson, bin_chunk.data, bin_chunk.length, options);
+        FGM_StatsStop(options->stats, FGM_STAGE_EXTRACT, &clock);
+    } else {
+        decoded = get_mesh_from_gjson(meshes, gson, &bin_chunk, options, share ? &sources : NULL);
     }
 
-    fread(chunk_type, 4, 1, fp); /* skipping type */
-    bin_chunk.data = malloc(sizeof(unsigned char)*bin_chunk.length);
-    fread(bin_chunk.data, bin_chunk.length, 1, fp);
+    if (decoded && options->hash_meshes && !(options->flags & GLB_FLAG_FLATTEN)) {
+        FGM_StatsStart(&clock);
+        decoded = hash_meshes(meshes, gson, &bin_chunk);
+        FGM_StatsStop(options->stats, FGM_STAGE_CACHE, &clock);
+    }
 
-    fclose(fp);
+    /* batches have no single source, only their content can be shared */
+    if (decoded && share) {
+        FGM_StatsStart(&clock);
+        decoded = share_streams(meshes, sources, options->flags);
+        FGM_StatsStop(options->stats, FGM_STAGE_EXTRACT, &clock);
+    }
+
+    free(sources);
+
+    if (decoded && options->flags != 0) {
+        FGM_StatsStart(&clock);
+        decoded = build_sections(meshes, gson, &bin_chunk, options);
+        FGM_StatsStop(options->stats, FGM_STAGE_EXTRACT, &clock);
+    }
+
+    /* only what was reached got built */
+    if (options->stats != NULL)
+        options->stats->nodes += gJSON_CountNodes(gson, NULL);
 
-    /* decoding */
-    gJSON *gson = gJSON_ParseWithLength(json_chunk.data, json_chunk.length);
-    unsigned char *mesh = get_mesh_from_gjson(num_meshes, sizes, gson, bin_chunk.data);
     gJSON_Delete(gson);
 
-    free(json_chunk.data);
-    free(bin_chunk.data);
+    if (!decoded) {
+        GLB_FreeMeshes(meshes);
+        return 0;
+    }
+
+    return 1;
+
+fail:
+
+    fprintf(stderr, "%s\n", log);
+    return 0;
+}
+
+int GLB_CheckHeader(const unsigned char *header)
+{
+    /* 12 byte header, signature, version (must be 2) then the file size */
+    uint32_t version;
+
+    memcpy(&version, header + 4, 4);
+
+    return version == 2 && (strncmp((const char*)header, SIGN_BE, 4) == 0 ||
+                            strncmp((const char*)header, SIGN_LE, 4) == 0);
+}
+
+int GLB_DecodeLayout(struct GLB_Layout *layout, const unsigned char *json, size_t json_length, uint64_t bin_length,
+                     const struct GLB_Options *options)
+{
+    /* resolves where every stream comes from in the BIN chunk without
+     * touching its data, so it can be streamed afterwards */
+
+    struct GLB_Options defaults = { 0, NULL };
+    GLB_Chunk bin = { NULL, (uint32_t)bin_length };
+    StatsClock clock;
+
+    if (options == NULL)
+        options = &defaults;
+
+    memset(layout, 0, sizeof(struct GLB_Layout));
+
+    FGM_StatsStart(&clock);
+    gJSON *gson = gJSON_ParseLazy(json, json_length);
+    FGM_StatsStop(options->stats, FGM_STAGE_PARSE, &clock);
+
+    if (gson == NULL) {
+        fprintf(stderr, "read_glb [Error] : could not parse json chunk\n");
+        return 0;
+    }
+
+    FGM_StatsStart(&clock);
+
+    gJSON *g_curr = gJSON_GetArrayItem(gJSON_GetObjectItem(gson, "meshes"), 0);
+    int count = 0;
+
+    for (; g_curr != NULL; g_curr = g_curr->next)
+        count++;
+
+    if (count == 0 || count > UINT16_MAX) {
+        fprintf(stderr, "get_mesh_from_gjson : Error, no meshes or more than %d\n", UINT16_MAX);
+        goto fail;
+    }
+
+    layout->sizes = malloc(sizeof(struct BufferSizes)*count);
+    layout->ranges = malloc(sizeof(struct GLB_Range)*count*GLB_ATTRIB_COUNT);
+
+    if (layout->sizes == NULL || layout->ranges == NULL)
+        goto fail;
+
+    for (int i = 0; i < count; i++) {
+        GLB_Attribute attribs[GLB_ATTRIB_COUNT];
 
+        if (!resolve_mesh(attribs, (uint16_t)i, gson, &bin))
+            goto fail;
 
-    return mesh;
+        for (int j = 0; j < GLB_ATTRIB_COUNT; j++) {
+            layout->ranges[i*GLB_ATTRIB_COUNT + j].offset = attribs[j].byteOffset;
+            layout->ranges[i*GLB_ATTRIB_COUNT + j].length = attribs[j].byteLength;
+            layout->ranges[i*GLB_ATTRIB_COUNT + j].stride = attribs[j].byteStride;
+            layout->ranges[i*GLB_ATTRIB_COUNT + j].element_size = (uint32_t)attribs[j].element_size;
+        }
+
+        layout->sizes[i].position = attribs[GLB_ATTRIB_POSITION].byteLength;
+        layout->sizes[i].normals = attribs[GLB_ATTRIB_NORMAL].byteLength;
+        layout->sizes[i].texcoords = attribs[GLB_ATTRIB_TEXCOORD].byteLength;
+        layout->sizes[i].indices = attribs[GLB_ATTRIB_INDICES].byteLength;
+    }
+
+    layout->num_meshes = (uint16_t)count;
+
+    FGM_StatsStop(options->stats, FGM_STAGE_ACCESSORS, &clock);
+    if (options->stats != NULL)
+        options->stats->nodes += gJSON_CountNodes(gson, NULL);
+    gJSON_Delete(gson);
+    return 1;
 
 fail:
+    FGM_StatsStop(options->stats, FGM_STAGE_ACCESSORS, &clock);
+    gJSON_Delete(gson);
+    GLB_FreeLayout(layout);
+    return 0;
+}
+
+void GLB_FreeLayout(struct GLB_Layout *layout)
+{
+    free(layout->sizes);
+    free(layout->ranges);
+    memset(layout, 0, sizeof(struct GLB_Layout));
+}
+
+int GLB_Decode(struct GLB_Meshes *meshes, const unsigned char *data, size_t length,
+               const struct GLB_Options *options)
+{
+    struct GLB_Options defaults = { 0, NULL };
 
-    printf("%s\n", log);
-    return NULL;
+    return read_glb(meshes, data, length, options != NULL ? options : &defaults);
 }
 
+void GLB_FreeMeshes(struct GLB_Meshes *meshes)
+{
+    free(meshes->sizes);
+    free(meshes->hashes);
+    free(meshes->buffer);
+
+    for (int i = 0; i < meshes->num_sections; i++)
+        free(meshes->sections[i].data);
+    free(meshes->sections);
+
+    memset(meshes, 0, sizeof(struct GLB_Meshes));
+}
 
 unsigned char *GLB_GetBufferData(uint16_t *num_meshes, struct BufferSizes **sizes, const char *path)
 {
-    return read_glb(num_meshes, sizes, path);
+    /* file based entry point, the buffer length is the sum of sizes */
+
+    struct GLB_Meshes meshes;
+    size_t length = 0;
+    unsigned char *data = FGM_ReadFile(path, &length);
+
+    if (data == NULL) {
+        fprintf(stderr, "read_glb [Error] : could not open file\n");
+        return NULL;
+    }
+
+    int decoded = GLB_Decode(&meshes, data, length, NULL);
+    free(data);
+
+    if (!decoded)
+        return NULL;
+
+    *num_meshes = meshes.num_meshes;
+    *sizes = meshes.sizes;
+
+    return meshes.buffer;
 }
@@ -1,7 +1,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "glb.h"
+#include "fgm.h"
+#include "cache.h"
+#include "xxhash.h"
+#include "stats.h"
 
 /* FGM (.fgm) is a file format which stand from "Fight Game Mesh". It is
  * a custom file format using data coming from GLTF (more accurately GLB)
@@ -18,43 +23,293 @@ void mesh_info(struct BufferSizes sizes)
             sizes.position, sizes.normals, sizes.indices, sizes.texcoords);
 }
 
+static uint64_t options_hash(uint32_t flags, int anim_fps)
+{
+    /* everything that changes the output for the same input goes here */
+    uint32_t options[3] = { FGM_CACHE_VERSION, flags, flags & GLB_FLAG_ANIM ? (uint32_t)anim_fps : 0 };
+
+    return XXH64(options, sizeof(options), 0);
+}
+
+static int up_to_date(struct CacheEntry *entry, uint64_t input_hash, uint64_t options, const char *fname)
+{
+    uint64_t hash, size;
+
+    if (entry->input_hash != input_hash || entry->options_hash != options)
+        return 0;
+
+    /* the output must still be the one we wrote */
+    if (!FGM_HashFile(fname, &hash, &size))
+        return 0;
+
+    return hash == entry->output_hash && size == entry->output_size;
+}
+
+static unsigned char *load_previous(struct GLB_Previous *previous, const struct CacheEntry *entry,
+                                    const char *fname)
+{
+    /* reads back the last output so the sections of its unchanged meshes
+     * can be copied, returns the data previous points into */
+
+    size_t size = 0;
+    unsigned char *data = FGM_ReadFile(fname, &size);
+
+    if (data == NULL)
+        return NULL;
+
+    if (size != entry->output_size || XXH64(data, size, 0) != entry->output_hash) {
+        free(data);
+        return NULL;
+    }
+
+    previous->num_meshes = entry->num_meshes;
+    previous->hashes = entry->mesh_hashes;
+    previous->fgm = data;
+    previous->length = size;
+
+    return data;
+}
+
+static int convert_stream(const char *path, const char *fname, uint32_t flags, int anim_fps,
+                          struct ConvertStats *stats, int json)
+{
+    /* pipe mode, nothing is cached and stdout only carries the FGM */
+
+    struct GLB_Options options = { flags, stats, anim_fps };
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    FILE *out = strcmp(fname, "-") == 0 ? stdout : fopen(fname, "wb");
+    int status;
+
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "Could not open %s aborting!\n", in == NULL ? path : fname);
+        if (in != NULL && in != stdin)
+            fclose(in);
+        if (out != NULL && out != stdout)
+            fclose(out);
+        return 1;
+    }
+
+    status = FGM_ConvertStream(in, out, &options);
+
+    if (in != stdin)
+        fclose(in);
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    if (!status) {
+        fprintf(stderr, "Could not decode glb stream aborting!\n");
+        return 1;
+    }
+
+    if (stats != NULL)
+        FGM_StatsPrint(stderr, stats, json);
+
+    return 0;
+}
+
+static void usage(void)
+{
+    printf("usage: app [--cache manifest] [--no-cache] [--stats[=json]]\n"
+           "           [--skin] [--anim[=fps]] [--bvh] [--tangents] [--flatten] [--textures]\n"
+           "           [--dedupe[=content]] [--morph] input.glb output.fgm\n"
+           "       '-' as input or output streams through stdin or stdout. A '-' input is only\n"
+           "       streamed without options and with streams in mesh order, otherwise up to the\n"
+           "       whole GLB is held in memory\n"
+           "       --skin adds a SKIN section, --anim an ANIM section resampled at fps (default %d)\n"
+           "       --bvh adds a BVH section for collision and ray queries\n"
+           "       --tangents adds TANGENT, generated when missing, as a fifth stream\n"
+           "       --flatten bakes the scene transforms and merges static meshes by material\n"
+           "       --textures copies the embedded images into a TEX section\n"
+           "       --dedupe writes streams shared between meshes once, =content also byte-identical ones\n"
+           "       --morph adds a MRPH section with the morph targets as sparse 16 bit deltas\n",
+           GLB_DEFAULT_ANIM_FPS);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3) {
+    char *path = NULL;
+    char *fname = NULL;
+    const char *manifest = FGM_CACHE_DEFAULT;
+    int use_cache = 1;
+    int show_stats = 0; /* 1 for text, 2 for json */
+    uint32_t flags = 0;
+    int anim_fps = GLB_DEFAULT_ANIM_FPS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            show_stats = 2;
+        } else if (strcmp(argv[i], "--skin") == 0) {
+            flags |= GLB_FLAG_SKIN;
+        } else if (strcmp(argv[i], "--morph") == 0) {
+            flags |= GLB_FLAG_MORPH;
+        } else if (strcmp(argv[i], "--dedupe") == 0) {
+            flags |= GLB_FLAG_SHARE;
+        } else if (strcmp(argv[i], "--dedupe=content") == 0) {
+            flags |= GLB_FLAG_SHARE | GLB_FLAG_SHARE_CONTENT;
+        } else if (strcmp(argv[i], "--textures") == 0) {
+            flags |= GLB_FLAG_TEXTURES;
+        } else if (strcmp(argv[i], "--flatten") == 0) {
+            flags |= GLB_FLAG_FLATTEN;
+        } else if (strcmp(argv[i], "--tangents") == 0) {
+            flags |= GLB_FLAG_TANGENTS;
+        } else if (strcmp(argv[i], "--bvh") == 0) {
+            flags |= GLB_FLAG_BVH;
+        } else if (strcmp(argv[i], "--anim") == 0) {
+            flags |= GLB_FLAG_ANIM;
+        } else if (strncmp(argv[i], "--anim=", 7) == 0 && atoi(argv[i] + 7) > 0) {
+            flags |= GLB_FLAG_ANIM;
+            anim_fps = atoi(argv[i] + 7);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            manifest = argv[++i];
+        } else if (path == NULL && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            path = argv[i];
+        } else if (fname == NULL && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            fname = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (path == NULL || fname == NULL) {
         printf("arguments must be path then name\n");
+        usage();
         return 1;
     }
 
-    char *path = argv[1];
-    char *fname = argv[2];
+    struct Cache cache;
+    struct CacheEntry *entry = NULL;
+    struct GLB_Previous previous = { 0, NULL, NULL, 0 };
+    unsigned char *previous_data = NULL;
+    uint64_t input_hash = 0;
+    uint64_t conversion_hash = options_hash(flags, anim_fps);
+    struct ConvertStats stats;
+    StatsClock clock;
+    size_t length = 0;
+
+    FGM_StatsInit(&stats);
+
+    if (strcmp(path, "-") == 0 || strcmp(fname, "-") == 0)
+        return convert_stream(path, fname, flags, anim_fps, show_stats ? &stats : NULL, show_stats == 2);
+
+    FGM_StatsStart(&clock);
+    unsigned char *data = FGM_ReadFile(path, &length);
+    FGM_StatsStop(&stats, FGM_STAGE_READ, &clock);
+
+    if (data == NULL) {
+        printf("Could not open %s aborting!\n", path);
+        return 1;
+    }
+
+    if (use_cache) {
+        FGM_StatsStart(&clock);
+        FGM_CacheLoad(&cache, manifest);
+        input_hash = XXH64(data, length, 0);
+
+        entry = FGM_CacheFind(&cache, fname);
+        int skip = entry != NULL && up_to_date(entry, input_hash, conversion_hash, fname);
+        FGM_StatsStop(&stats, FGM_STAGE_CACHE, &clock);
+
+        if (skip) {
+            printf("%s is up to date\n", fname);
+            if (show_stats)
+                FGM_StatsPrint(stderr, &stats, show_stats == 2);
+            FGM_CacheFree(&cache);
+            free(data);
+            return 0;
+        }
+
+        /* a changed input converted with the same options copies the
+         * costly sections of the meshes that did not change */
+        FGM_StatsStart(&clock);
+        if (entry != NULL && entry->options_hash == conversion_hash && entry->num_meshes > 0 &&
+            (flags & GLB_FLAGS_REUSED))
+            previous_data = load_previous(&previous, entry, fname);
+        FGM_StatsStop(&stats, FGM_STAGE_CACHE, &clock);
+    }
 
-    uint16_t num_meshes = 0;
-    struct BufferSizes *sizes = NULL;
-    unsigned char *buffer = GLB_GetBufferData(&num_meshes, &sizes, path);
+    struct GLB_Options options = { flags, show_stats ? &stats : NULL, anim_fps, 0,
+                                   use_cache && (flags & GLB_FLAGS_REUSED) && !(flags & GLB_FLAG_FLATTEN),
+                                   previous_data != NULL ? &previous : NULL };
+    struct GLB_Meshes meshes;
 
-    if (buffer == NULL) {
+    int decoded = GLB_Decode(&meshes, data, length, &options);
+
+    free(data);
+    free(previous_data);
+
+    if (!decoded) {
         printf("Could not decode glb file aborting!\n");
+        if (use_cache)
+            FGM_CacheFree(&cache);
         return 1;
     }
 
+    FGM_StatsStart(&clock);
+
+    size_t fgm_length = FGM_Size(&meshes);
+    unsigned char *fgm = malloc(fgm_length);
     FILE *fp = fopen(fname, "wb");
-    fwrite(&num_meshes, sizeof(uint16_t), 1, fp);
-    for (int i =0; i < num_meshes; i++) {
-        fwrite(&sizes[i].position, sizeof(uint64_t), 1, fp);
-        fwrite(&sizes[i].normals, sizeof(uint64_t), 1, fp);
-        fwrite(&sizes[i].texcoords, sizeof(uint64_t), 1, fp);
-        fwrite(&sizes[i].indices, sizeof(uint64_t), 1, fp);
 
+    if (fgm == NULL || fp == NULL) {
+        printf("Could not write %s aborting!\n", fname);
+        if (fp != NULL)
+            fclose(fp);
+        free(fgm);
+        GLB_FreeMeshes(&meshes);
+        if (use_cache)
+            FGM_CacheFree(&cache);
+        return 1;
+    }
+
+    FGM_Write(&meshes, fgm);
+    fwrite(fgm, fgm_length, 1, fp);
+    fclose(fp);
+
+    /* hashed while still in memory rather than read back for the cache */
+    uint64_t output_hash = use_cache ? XXH64(fgm, fgm_length, 0) : 0;
+    free(fgm);
+
+    stats.bytes_written = fgm_length;
+    FGM_StatsStop(&stats, FGM_STAGE_WRITE, &clock);
+
+    for (int i =0; i < meshes.num_meshes; i++) {
         printf("%d:\n", i);
-        mesh_info(sizes[i]);
+        mesh_info(meshes.sizes[i]);
     }
 
-    fwrite(buffer, buffer_position, 1, fp);
+    if (use_cache) {
+        FGM_StatsStart(&clock);
 
-    fclose(fp);
+        if ((entry = FGM_CacheUpdate(&cache, path, fname)) != NULL) {
+            entry->input_hash = input_hash;
+            entry->options_hash = conversion_hash;
+            entry->output_hash = output_hash;
+            entry->output_size = fgm_length;
+
+            if (meshes.hashes != NULL) {
+                entry->num_meshes = meshes.num_meshes;
+                entry->mesh_hashes = meshes.hashes;
+                meshes.hashes = NULL;
+            }
+
+            FGM_CacheSave(&cache);
+        }
+        FGM_CacheFree(&cache);
+
+        FGM_StatsStop(&stats, FGM_STAGE_CACHE, &clock);
+    }
+
+    if (show_stats)
+        FGM_StatsPrint(stderr, &stats, show_stats == 2);
 
-    free(buffer);
-    free(sizes);
+    GLB_FreeMeshes(&meshes);
 
 
     return 0;
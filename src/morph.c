@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "morph.h"
+#include "accessor.h"
+
+typedef struct
+{
+    uint32_t moved;
+    uint32_t flags;
+    uint64_t indices;
+    uint64_t deltas;
+    float position_scale[3];
+    float normal_scale;
+    float weight;
+    uint32_t reserved;
+} MorphTarget;
+
+static int read_delta(float **deltas, gJSON *gtarget, const char *name, gJSON *gson, const unsigned char *bin,
+                      size_t bin_length, int vertex_count)
+{
+    /* 3 floats per vertex. 1 when read, 0 when the target does not move
+     * this attribute and -1 when its accessor is invalid */
+
+    gJSON *item = gJSON_GetObjectItem(gtarget, name);
+    GLB_Accessor accessor;
+
+    *deltas = NULL;
+
+    if (item == NULL)
+        return 0;
+
+    if (!GLB_GetAccessor(&accessor, gson, item->valueint, bin, bin_length) || accessor.count != vertex_count) {
+        fprintf(stderr, "FGM_BuildMorphs : Error, %s delta accessor %d does not match %d vertices\n",
+               name, item->valueint, vertex_count);
+        return -1;
+    }
+
+    *deltas = GLB_ReadFloats(&accessor, 3);
+
+    return *deltas != NULL ? 1 : -1;
+}
+
+static void quantize(int16_t *out, const float *deltas, int vertex_count, const float *scale)
+{
+    for (int v = 0; v < vertex_count; v++) {
+        for (int j = 0; j < 3; j++) {
+            float q = scale[j] > 0.0f ? roundf(deltas[(size_t)v*3 + j] / scale[j]) : 0.0f;
+            out[(size_t)v*3 + j] = (int16_t)(q > 32767.0f ? 32767 : (q < -32767.0f ? -32767 : q));
+        }
+    }
+}
+
+static void max_abs(float *out, const float *deltas, int vertex_count)
+{
+    out[0] = out[1] = out[2] = 0.0f;
+
+    for (size_t i = 0; i < (size_t)vertex_count*3; i++) {
+        if (fabsf(deltas[i]) > out[i % 3])
+            out[i % 3] = fabsf(deltas[i]);
+    }
+}
+
+static int add_target(FGM_Bytes *bytes, MorphTarget *target, gJSON *gtarget, gJSON *gson,
+                      const unsigned char *bin, size_t bin_length, int vertex_count)
+{
+    /* appends the moved vertex indices then their interleaved deltas */
+
+    float *positions = NULL, *normals = NULL;
+    int16_t *qpositions = NULL, *qnormals = NULL;
+    int16_t *deltas = NULL;
+    uint32_t *indices = NULL;
+    size_t count = (size_t)(vertex_count > 0 ? vertex_count : 1);
+    float range[3];
+
+    if (read_delta(&positions, gtarget, "POSITION", gson, bin, bin_length, vertex_count) < 0 ||
+        read_delta(&normals, gtarget, "NORMAL", gson, bin, bin_length, vertex_count) < 0)
+        goto fail;
+
+    if (positions != NULL) {
+        target->flags |= FGM_MORPH_POSITION;
+        max_abs(range, positions, vertex_count);
+
+        for (int j = 0; j < 3; j++)
+            target->position_scale[j] = range[j] / 32767.0f;
+
+        if ((qpositions = malloc(sizeof(int16_t)*3*count)) == NULL)
+            goto fail;
+        quantize(qpositions, positions, vertex_count, target->position_scale);
+    }
+
+    if (normals != NULL) {
+        target->flags |= FGM_MORPH_NORMAL;
+        max_abs(range, normals, vertex_count);
+
+        /* one scale, normal deltas are not stretched along an axis */
+        target->normal_scale = fmaxf(range[0], fmaxf(range[1], range[2])) / 32767.0f;
+
+        float scale[3] = { target->normal_scale, target->normal_scale, target->normal_scale };
+
+        if ((qnormals = malloc(sizeof(int16_t)*3*count)) == NULL)
+            goto fail;
+        quantize(qnormals, normals, vertex_count, scale);
+    }
+
+    int stride = ((qpositions != NULL) + (qnormals != NULL))*3;
+
+    indices = malloc(sizeof(uint32_t)*count);
+    deltas = malloc(sizeof(int16_t)*(stride > 0 ? stride : 1)*count);
+
+    if (indices == NULL || deltas == NULL)
+        goto fail;
+
+    /* a vertex moves when one of its deltas survives quantization */
+    for (int v = 0; v < vertex_count; v++) {
+        int16_t *delta = deltas + (size_t)target->moved*stride;
+        int moves = 0;
+
+        if (qpositions != NULL) {
+            memcpy(delta, qpositions + (size_t)v*3, sizeof(int16_t)*3);
+            delta += 3;
+        }
+
+        if (qnormals != NULL)
+            memcpy(delta, qnormals + (size_t)v*3, sizeof(int16_t)*3);
+
+        for (int j = 0; j < stride; j++)
+            moves |= deltas[(size_t)target->moved*stride + j] != 0;
+
+        if (moves)
+            indices[target->moved++] = (uint32_t)v;
+    }
+
+    FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+
+    if (vertex_count <= 65536) {
+        uint16_t *narrow = malloc(sizeof(uint16_t)*(target->moved > 0 ? target->moved : 1));
+
+        if (narrow == NULL)
+            goto fail;
+
+        for (uint32_t i = 0; i < target->moved; i++)
+            narrow[i] = (uint16_t)indices[i];
+
+        target->flags |= FGM_MORPH_INDEX16;
+        target->indices = FGM_BytesAppend(bytes, narrow, sizeof(uint16_t)*target->moved);
+        free(narrow);
+    } else {
+        target->indices = FGM_BytesAppend(bytes, indices, sizeof(uint32_t)*target->moved);
+    }
+
+    FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+    target->deltas = FGM_BytesAppend(bytes, deltas, sizeof(int16_t)*stride*target->moved);
+
+    free(positions);
+    free(normals);
+    free(qpositions);
+    free(qnormals);
+    free(indices);
+    free(deltas);
+
+    return 1;
+
+fail:
+    free(positions);
+    free(normals);
+    free(qpositions);
+    free(qnormals);
+    free(indices);
+    free(deltas);
+
+    return 0;
+}
+
+int FGM_BuildMorphs(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes)
+{
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+    uint32_t total = 0;
+
+    /* targets of the first primitive of every mesh, like the other sections */
+    for (int m = 0; m < num_meshes; m++) {
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(gmeshes, m), "primitives"), 0);
+        gJSON *gtargets = gJSON_GetObjectItem(gprim, "targets");
+
+        for (gJSON *gtarget = gJSON_GetArrayItem(gtargets, 0); gtarget != NULL;
+             gtarget = gtarget->next)
+            total++;
+    }
+
+    uint32_t header[4] = { (uint32_t)num_meshes, total, 16, 16 + 16*(uint32_t)num_meshes };
+    size_t targets_offset = header[3];
+    uint32_t first = 0;
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 16*(size_t)num_meshes + sizeof(MorphTarget)*total);
+
+    for (int m = 0; m < num_meshes; m++) {
+        gJSON *gmesh = gJSON_GetArrayItem(gmeshes, m);
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gmesh, "primitives"), 0);
+        gJSON *gtargets = gJSON_GetObjectItem(gprim, "targets");
+        gJSON *gweights = gJSON_GetObjectItem(gmesh, "weights");
+        gJSON *gposition = gJSON_GetObjectItem(gJSON_GetObjectItem(gprim, "attributes"), "POSITION");
+        GLB_Accessor position;
+        uint32_t count = 0;
+        int vertex_count = 0;
+
+        if (gposition != NULL && GLB_GetAccessor(&position, gson, gposition->valueint, bin, bin_length))
+            vertex_count = position.count;
+
+        for (gJSON *gtarget = gJSON_GetArrayItem(gtargets, 0); gtarget != NULL;
+             gtarget = gtarget->next, count++) {
+            gJSON *gweight = gJSON_GetArrayItem(gweights, (int)count);
+            MorphTarget target;
+
+            memset(&target, 0, sizeof(MorphTarget));
+            target.weight = gweight != NULL ? (float)gweight->valuedouble : 0.0f;
+
+            if (!add_target(bytes, &target, gtarget, gson, bin, bin_length, vertex_count))
+                return 0;
+
+            FGM_BytesPatch(bytes, targets_offset + sizeof(MorphTarget)*(first + count), &target, sizeof(MorphTarget));
+        }
+
+        /* first target, target count, vertex count, reserved */
+        uint32_t entry[4] = { first, count, (uint32_t)vertex_count, 0 };
+
+        FGM_BytesPatch(bytes, 16 + 16*(size_t)m, entry, sizeof(entry));
+        first += count;
+    }
+
+    return !bytes->failed;
+}
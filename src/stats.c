@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+static const char *stage_names[FGM_STAGE_COUNT] = {
+    "read", "parse", "accessors", "extract", "cache", "write"
+};
+
+static uint64_t allocations = 0;
+static uint64_t frees = 0;
+static uint64_t allocated_bytes = 0;
+
+void FGM_StatsCountAllocation(size_t size)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+}
+
+void FGM_StatsCountFree(void)
+{
+    __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+}
+
+void FGM_StatsAllocations(uint64_t *allocations_out, uint64_t *frees_out, uint64_t *bytes_out)
+{
+    if (allocations_out != NULL)
+        *allocations_out = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    if (frees_out != NULL)
+        *frees_out = __atomic_load_n(&frees, __ATOMIC_RELAXED);
+    if (bytes_out != NULL)
+        *bytes_out = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+}
+
+void FGM_StatsInit(struct ConvertStats *stats)
+{
+    memset(stats, 0, sizeof(struct ConvertStats));
+    FGM_StatsAllocations(&stats->allocations_start, NULL, NULL);
+}
+
+static void read_clock(StatsClock *clock)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    clock->wall = (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    clock->cpu = (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+void FGM_StatsStart(StatsClock *start)
+{
+    read_clock(start);
+}
+
+void FGM_StatsStop(struct ConvertStats *stats, enum FGM_Stage stage, const StatsClock *start)
+{
+    /* stages are accumulated, a stage may be entered once per mesh */
+    StatsClock end;
+
+    if (stats == NULL)
+        return;
+
+    read_clock(&end);
+    stats->stages[stage].wall += end.wall - start->wall;
+    stats->stages[stage].cpu += end.cpu - start->cpu;
+}
+
+void FGM_StatsPrint(FILE *fp, struct ConvertStats *stats, int json)
+{
+    struct rusage usage;
+    StatsClock total = { 0, 0 };
+
+    getrusage(RUSAGE_SELF, &usage);
+    stats->peak_rss_kb = usage.ru_maxrss;
+
+    FGM_StatsAllocations(&stats->allocations, NULL, NULL);
+    stats->allocations -= stats->allocations_start;
+
+    for (int i = 0; i < FGM_STAGE_COUNT; i++) {
+        total.wall += stats->stages[i].wall;
+        total.cpu += stats->stages[i].cpu;
+    }
+
+    if (json) {
+        fprintf(fp, "{\"stages\":{");
+        for (int i = 0; i < FGM_STAGE_COUNT; i++)
+            fprintf(fp, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", i > 0 ? "," : "", stage_names[i],
+                    stats->stages[i].wall*1e3, stats->stages[i].cpu*1e3);
+
+        fprintf(fp, "},\"total_wall_ms\":%.3f,\"total_cpu_ms\":%.3f,\"nodes\":%lu,\"allocations\":%lu,"
+                "\"bytes_copied\":%lu,\"bytes_written\":%lu,\"sections_reused\":%lu,\"peak_rss_kb\":%ld}\n",
+                total.wall*1e3, total.cpu*1e3, (unsigned long)stats->nodes, (unsigned long)stats->allocations,
+                (unsigned long)stats->bytes_copied, (unsigned long)stats->bytes_written,
+                (unsigned long)stats->sections_reused, stats->peak_rss_kb);
+        return;
+    }
+
+    fprintf(fp, "== CONVERSION STATS ==\n%-10s %12s %12s\n", "stage", "wall (ms)", "cpu (ms)");
+    for (int i = 0; i < FGM_STAGE_COUNT; i++)
+        fprintf(fp, "%-10s %12.3f %12.3f\n", stage_names[i], stats->stages[i].wall*1e3, stats->stages[i].cpu*1e3);
+    fprintf(fp, "%-10s %12.3f %12.3f\n\n", "total", total.wall*1e3, total.cpu*1e3);
+
+    fprintf(fp, "Nodes: %lu\nAllocations: %lu\nBytes copied: %lu\nBytes written: %lu\nSections reused: %lu\n"
+            "Peak RSS: %ld KiB\n",
+            (unsigned long)stats->nodes, (unsigned long)stats->allocations, (unsigned long)stats->bytes_copied,
+            (unsigned long)stats->bytes_written, (unsigned long)stats->sections_reused, stats->peak_rss_kb);
+}
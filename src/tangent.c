@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tangent.h"
+#include "accessor.h"
+
+static float dot3(const float *a, const float *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static float normalize3(float *v)
+{
+    float length = sqrtf(dot3(v, v));
+
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+
+    return length;
+}
+
+static void project(float *v, const float *n)
+{
+    /* removes the part of v along n */
+    float d = dot3(v, n);
+
+    v[0] -= n[0]*d;
+    v[1] -= n[1]*d;
+    v[2] -= n[2]*d;
+}
+
+static float corner_angle(const float *p, const float *a, const float *b, const float *n)
+{
+    /* angle at p between the edges to a and b, measured in the plane of
+     * the vertex normal n */
+
+    float e1[3] = { a[0] - p[0], a[1] - p[1], a[2] - p[2] };
+    float e2[3] = { b[0] - p[0], b[1] - p[1], b[2] - p[2] };
+    float c;
+
+    project(e1, n);
+    project(e2, n);
+
+    if (normalize3(e1) == 0.0f || normalize3(e2) == 0.0f)
+        return 0.0f;
+
+    c = dot3(e1, e2);
+    return acosf(c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c));
+}
+
+static int generate(float *tangents, const float *positions, const float *normals, const float *texcoords,
+                    const uint32_t *vertices, uint32_t triangle_count, int vertex_count)
+{
+    /* per corner like MikkTSpace : the face tangent is projected on the
+     * vertex normal plane and weighted by the corner angle in that plane.
+     * Unlike MikkTSpace the vertices are not split, the stream has to match
+     * the other mesh streams, so where mirrored faces share a vertex the
+     * orientation carrying the most weight wins and the other side gets
+     * its tangent. Returns 0 when out of memory */
+
+    float *sums = calloc((size_t)vertex_count*8, sizeof(float)); /* xyz + weight, per orientation */
+
+    if (sums == NULL)
+        return 0;
+
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        const uint32_t *tri = vertices + t*3;
+        const float *p0 = positions + tri[0]*3, *p1 = positions + tri[1]*3, *p2 = positions + tri[2]*3;
+        const float *uv0 = texcoords + tri[0]*2, *uv1 = texcoords + tri[1]*2, *uv2 = texcoords + tri[2]*2;
+
+        float d1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float d2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float t21x = uv1[0] - uv0[0], t21y = uv1[1] - uv0[1];
+        float t31x = uv2[0] - uv0[0], t31y = uv2[1] - uv0[1];
+        float sign = t21x*t31y - t21y*t31x < 0.0f ? -1.0f : 1.0f;
+
+        /* directions of increasing u and v over the face */
+        float os[3], ot[3];
+        for (int i = 0; i < 3; i++) {
+            os[i] = (t31y*d1[i] - t21y*d2[i])*sign;
+            ot[i] = (t21x*d2[i] - t31x*d1[i])*sign;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            uint32_t v = tri[c];
+            float tangent[3] = { os[0], os[1], os[2] };
+            float n[3] = { normals[v*3], normals[v*3 + 1], normals[v*3 + 2] };
+
+            normalize3(n);
+            project(tangent, n);
+            if (normalize3(tangent) == 0.0f)
+                continue;
+
+            /* handedness against the vertex normal, not the winding :
+             * bitangent = w * cross(normal, tangent) */
+            float cross[3] = { n[1]*tangent[2] - n[2]*tangent[1], n[2]*tangent[0] - n[0]*tangent[2],
+                               n[0]*tangent[1] - n[1]*tangent[0] };
+            int group = dot3(cross, ot) < 0.0f ? 1 : 0;
+
+            float weight = corner_angle(positions + v*3, positions + tri[(c + 1) % 3]*3,
+                                        positions + tri[(c + 2) % 3]*3, n);
+            float *sum = sums + (size_t)v*8 + group*4;
+
+            sum[0] += tangent[0]*weight;
+            sum[1] += tangent[1]*weight;
+            sum[2] += tangent[2]*weight;
+            sum[3] += weight;
+        }
+    }
+
+    for (int v = 0; v < vertex_count; v++) {
+        float *sum = sums + (size_t)v*8;
+        int group = sum[7] > sum[3] ? 1 : 0;
+        float *tangent = tangents + (size_t)v*4;
+        float n[3] = { normals[v*3], normals[v*3 + 1], normals[v*3 + 2] };
+
+        memcpy(tangent, sum + group*4, sizeof(float)*3);
+        tangent[3] = group ? -1.0f : 1.0f;
+
+        normalize3(n);
+        project(tangent, n);
+
+        /* unused vertices or no texcoord gradient, any direction in the plane */
+        if (normalize3(tangent) == 0.0f) {
+            float axis[3] = { fabsf(n[0]) < 0.9f ? 1.0f : 0.0f, fabsf(n[0]) < 0.9f ? 0.0f : 1.0f, 0.0f };
+
+            memcpy(tangent, axis, sizeof(axis));
+            project(tangent, n);
+            normalize3(tangent);
+        }
+    }
+
+    free(sums);
+    return 1;
+}
+
+static int read_attribute(GLB_Accessor *accessor, gJSON *gattr, const char *name, gJSON *gson,
+                          const unsigned char *bin, size_t bin_length)
+{
+    /* 1 when read, 0 when the primitive has no such attribute and -1 when it is invalid */
+
+    gJSON *item = gJSON_GetObjectItem(gattr, name);
+
+    if (item == NULL)
+        return 0;
+
+    return GLB_GetAccessor(accessor, gson, item->valueint, bin, bin_length) ? 1 : -1;
+}
+
+static int mesh_tangents(float **tangents, gJSON *gprim, gJSON *gson, const unsigned char *bin, size_t bin_length,
+                         int *vertex_count, uint32_t *flags)
+{
+    /* float4 per vertex, left NULL when the mesh can not have any. Returns 0
+     * on invalid data, which fails the section instead of dropping the stream */
+
+    gJSON *gattr = gJSON_GetObjectItem(gprim, "attributes");
+    gJSON *gmode = gJSON_GetObjectItem(gprim, "mode");
+    gJSON *gindices = gJSON_GetObjectItem(gprim, "indices");
+    GLB_Accessor accessor, position, normal, texcoord, indices;
+    float *positions = NULL, *normals = NULL, *texcoords = NULL;
+    uint32_t *vertices = NULL;
+    uint32_t triangle_count;
+    int found;
+
+    *tangents = NULL;
+    *vertex_count = 0;
+    *flags = 0;
+
+    if ((found = read_attribute(&accessor, gattr, "TANGENT", gson, bin, bin_length)) != 0) {
+        /* one tangent per vertex, the stream sits next to the positions */
+        if (found < 0 || read_attribute(&position, gattr, "POSITION", gson, bin, bin_length) != 1 ||
+            accessor.count != position.count || (*tangents = GLB_ReadFloats(&accessor, 4)) == NULL)
+            return 0;
+
+        *vertex_count = accessor.count;
+        return 1;
+    }
+
+    *flags = FGM_TANGENT_GENERATED;
+
+    if (gmode != NULL && gmode->valueint != 4)
+        return 1;
+
+    int attributes[3] = {
+        read_attribute(&position, gattr, "POSITION", gson, bin, bin_length),
+        read_attribute(&normal, gattr, "NORMAL", gson, bin, bin_length),
+        read_attribute(&texcoord, gattr, "TEXCOORD_0", gson, bin, bin_length),
+    };
+
+    if (attributes[0] < 0 || attributes[1] < 0 || attributes[2] < 0 ||
+        (gindices != NULL && !GLB_GetAccessor(&indices, gson, gindices->valueint, bin, bin_length)))
+        return 0;
+
+    /* nothing to generate from */
+    if (attributes[0] == 0 || attributes[1] == 0 || attributes[2] == 0 ||
+        normal.count != position.count || texcoord.count != position.count)
+        return 1;
+
+    positions = GLB_ReadFloats(&position, 3);
+    normals = GLB_ReadFloats(&normal, 3);
+    texcoords = GLB_ReadFloats(&texcoord, 2);
+
+    /* only a primitive without indices is a plain triangle list */
+    if (gindices != NULL) {
+        vertices = GLB_ReadUints(&indices, 1);
+        triangle_count = (uint32_t)(indices.count / 3);
+    } else {
+        vertices = malloc(sizeof(uint32_t)*(position.count > 0 ? position.count : 1));
+        for (int i = 0; vertices != NULL && i < position.count; i++)
+            vertices[i] = (uint32_t)i;
+        triangle_count = (uint32_t)(position.count / 3);
+    }
+
+    *tangents = calloc(position.count > 0 ? position.count : 1, sizeof(float)*4);
+
+    if (positions == NULL || normals == NULL || texcoords == NULL || vertices == NULL || *tangents == NULL)
+        goto fail;
+
+    for (uint32_t i = 0; i < triangle_count*3; i++) {
+        if (vertices[i] >= (uint32_t)position.count) {
+            fprintf(stderr, "FGM_BuildTangents : Error, index %u out of %d vertices\n", vertices[i], position.count);
+            goto fail;
+        }
+    }
+
+    if (!generate(*tangents, positions, normals, texcoords, vertices, triangle_count, position.count))
+        goto fail;
+    *vertex_count = position.count;
+
+    free(positions);
+    free(normals);
+    free(texcoords);
+    free(vertices);
+
+    return 1;
+
+fail:
+    free(*tangents);
+    free(positions);
+    free(normals);
+    free(texcoords);
+    free(vertices);
+
+    *tangents = NULL;
+    return 0;
+}
+
+static int copy_mesh(FGM_Bytes *bytes, FGM_Reuse *reuse, int m, unsigned char entry[16])
+{
+    /* appends the stream of mesh m from the previous output and fills its
+     * entry, 0 when the mesh changed or is not in that section */
+
+    const unsigned char *section = reuse != NULL ? reuse->section : NULL;
+    int previous = reuse != NULL ? reuse->previous[m] : -1;
+    uint32_t header[4], count;
+    uint64_t offset;
+
+    if (section == NULL || previous < 0 || reuse->length < sizeof(header))
+        return 0;
+
+    memcpy(header, section, sizeof(header));
+
+    if ((uint32_t)previous >= header[0] || header[1] > reuse->length || (reuse->length - header[1]) / 16 <= (size_t)previous)
+        return 0;
+
+    const unsigned char *old = section + header[1] + 16*(size_t)previous;
+
+    memcpy(&offset, old, 8);
+    memcpy(&count, old + 8, 4);
+
+    if (count > 0 && (offset > reuse->length || (reuse->length - offset) / 16 < count))
+        return 0;
+
+    memcpy(entry, old, 16);
+
+    if (count > 0) {
+        FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+        uint64_t copy = FGM_BytesAppend(bytes, section + offset, 16*(size_t)count);
+        memcpy(entry, &copy, 8);
+    }
+
+    reuse->reused++;
+    return 1;
+}
+
+int FGM_BuildTangents(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length, int num_meshes,
+                      FGM_Reuse *reuse)
+{
+    gJSON *gmeshes = gJSON_GetObjectItem(gson, "meshes");
+
+    uint32_t header[4] = { (uint32_t)num_meshes, 16, 0, 0 };
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 16*(size_t)num_meshes);
+
+    for (int m = 0; m < num_meshes; m++) {
+        unsigned char copied[16];
+
+        if (copy_mesh(bytes, reuse, m, copied)) {
+            FGM_BytesPatch(bytes, 16 + 16*(size_t)m, copied, sizeof(copied));
+            continue;
+        }
+
+        gJSON *gprim = gJSON_GetArrayItem(gJSON_GetObjectItem(gJSON_GetArrayItem(gmeshes, m), "primitives"), 0);
+        int vertex_count;
+        uint32_t flags;
+        uint64_t offset = 0;
+        float *tangents;
+
+        if (!mesh_tangents(&tangents, gprim, gson, bin, bin_length, &vertex_count, &flags)) {
+            fprintf(stderr, "FGM_BuildTangents : Error, mesh %d has invalid tangent inputs\n", m);
+            return 0;
+        }
+
+        if (tangents != NULL) {
+            FGM_BytesAlign(bytes, FGM_SECTION_ALIGN);
+            offset = FGM_BytesAppend(bytes, tangents, sizeof(float)*4*(size_t)vertex_count);
+            free(tangents);
+        } else {
+            vertex_count = 0;
+        }
+
+        /* uint64 offset, uint32 vertex count, uint32 flags */
+        unsigned char entry[16];
+        uint32_t count = (uint32_t)vertex_count;
+
+        memcpy(entry, &offset, 8);
+        memcpy(entry + 8, &count, 4);
+        memcpy(entry + 12, &flags, 4);
+        FGM_BytesPatch(bytes, 16 + 16*(size_t)m, entry, sizeof(entry));
+    }
+
+    return !bytes->failed;
+}
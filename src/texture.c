@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture.h"
+#include "accessor.h"
+
+static uint32_t read_be(const unsigned char *p, int bytes)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | p[i];
+
+    return value;
+}
+
+static int png_size(const unsigned char *data, size_t length, uint32_t *width, uint32_t *height)
+{
+    /* signature then IHDR, always the first chunk */
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    if (length < 24 || memcmp(data, signature, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0)
+        return 0;
+
+    *width = read_be(data + 16, 4);
+    *height = read_be(data + 20, 4);
+
+    return 1;
+}
+
+static int jpeg_size(const unsigned char *data, size_t length, uint32_t *width, uint32_t *height)
+{
+    /* walks the markers up to the first start of frame */
+
+    size_t offset = 2;
+
+    if (length < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return 0;
+
+    while (offset + 4 <= length) {
+        if (data[offset] != 0xFF)
+            return 0;
+
+        unsigned char marker = data[offset + 1];
+
+        /* fill bytes and markers without a length */
+        if (marker == 0xFF) {
+            offset++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            offset += 2;
+            continue;
+        }
+
+        uint32_t segment = read_be(data + offset + 2, 2);
+
+        /* SOF0 to SOF15 except DHT, JPG and DAC */
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (offset + 9 > length)
+                return 0;
+
+            *height = read_be(data + offset + 5, 2);
+            *width = read_be(data + offset + 7, 2);
+            return 1;
+        }
+
+        if (marker == 0xDA || segment < 2)
+            return 0;
+
+        offset += 2 + segment;
+    }
+
+    return 0;
+}
+
+int FGM_BuildTextures(FGM_Bytes *bytes, gJSON *gson, const unsigned char *bin, size_t bin_length)
+{
+    gJSON *gimages = gJSON_GetObjectItem(gson, "images");
+    int image_count = 0;
+
+    for (gJSON *image = gJSON_GetArrayItem(gimages, 0); image != NULL; image = image->next)
+        image_count++;
+
+    uint32_t header[4] = { (uint32_t)image_count, 16, FGM_TEXTURE_ALIGN, 0 };
+
+    FGM_BytesAppend(bytes, header, sizeof(header));
+    FGM_BytesAppend(bytes, NULL, 48*(size_t)image_count);
+
+    gJSON *gimage = gJSON_GetArrayItem(gimages, 0);
+
+    for (int i = 0; gimage != NULL; i++, gimage = gimage->next) {
+        gJSON *gview = gJSON_GetObjectItem(gimage, "bufferView");
+        gJSON *gmime = gJSON_GetObjectItem(gimage, "mimeType");
+        const unsigned char *data = NULL;
+        size_t length = 0;
+        uint64_t offset = 0, size = 0;
+        uint32_t width = 0, height = 0, format = FGM_TEXTURE_EXTERNAL;
+        char mime[FGM_TEXTURE_MIME] = { 0 };
+
+        if (gview != NULL) {
+            if (!GLB_GetBufferView(gson, gview->valueint, bin, bin_length, &data, &length)) {
+                fprintf(stderr, "FGM_BuildTextures : Error, image %d has an invalid bufferView\n", i);
+                return 0;
+            }
+
+            /* the header decides, the declared mime type is only kept */
+            if (png_size(data, length, &width, &height))
+                format = FGM_TEXTURE_PNG;
+            else if (jpeg_size(data, length, &width, &height))
+                format = FGM_TEXTURE_JPEG;
+            else
+                format = FGM_TEXTURE_OTHER;
+
+            FGM_BytesAlign(bytes, FGM_TEXTURE_ALIGN);
+            offset = FGM_BytesAppend(bytes, data, length);
+            size = length;
+        }
+
+        if (gmime != NULL && gmime->valuestring != NULL)
+            strncpy(mime, gmime->valuestring, FGM_TEXTURE_MIME - 1);
+
+        /* uint64 offset, uint64 length, uint32 width, height, format, reserved, mime */
+        unsigned char entry[48] = { 0 };
+
+        memcpy(entry, &offset, 8);
+        memcpy(entry + 8, &size, 8);
+        memcpy(entry + 16, &width, 4);
+        memcpy(entry + 20, &height, 4);
+        memcpy(entry + 24, &format, 4);
+        memcpy(entry + 32, mime, FGM_TEXTURE_MIME);
+        FGM_BytesPatch(bytes, 16 + 48*(size_t)i, entry, sizeof(entry));
+    }
+
+    return !bytes->failed;
+}
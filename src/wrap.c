@@ -0,0 +1,44 @@
+/* Allocation counting for the programs of this repository, linked with
+ * ALLOC_WRAP (see the Makefile) so that every malloc/calloc/realloc/free of
+ * the process, BVH threads included, goes through these. Not part of the
+ * library : a program embedding the converter links without it and
+ * FGM_StatsAllocations reports 0 */
+
+#include <stdlib.h>
+
+#include "stats.h"
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void*, size_t);
+void __real_free(void*);
+
+void *__wrap_malloc(size_t);
+void *__wrap_calloc(size_t, size_t);
+void *__wrap_realloc(void*, size_t);
+void __wrap_free(void*);
+
+void *__wrap_malloc(size_t size)
+{
+    FGM_StatsCountAllocation(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    FGM_StatsCountAllocation(count*size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    FGM_StatsCountAllocation(size);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL)
+        FGM_StatsCountFree();
+    __real_free(ptr);
+}
@@ -0,0 +1,160 @@
+#include <string.h>
+
+#include "xxhash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define rotl64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static uint64_t read64(const unsigned char *p)
+{
+    /* little endian read regardless of host and alignment */
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t merge_round64(uint64_t acc, uint64_t val)
+{
+    acc ^= round64(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t finalize64(uint64_t h, const unsigned char *p, size_t len)
+{
+    /* consumes the last (len < 32) bytes then avalanches */
+    while (len >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+
+    if (len >= 4) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+
+    while (len > 0) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+uint64_t XXH64(const void *input, size_t len, uint64_t seed)
+{
+    XXH64_State state;
+
+    XXH64_Init(&state, seed);
+    XXH64_Update(&state, input, len);
+
+    return XXH64_Digest(&state);
+}
+
+void XXH64_Init(XXH64_State *state, uint64_t seed)
+{
+    memset(state, 0, sizeof(XXH64_State));
+
+    state->seed = seed;
+    state->v[0] = seed + PRIME64_1 + PRIME64_2;
+    state->v[1] = seed + PRIME64_2;
+    state->v[2] = seed;
+    state->v[3] = seed - PRIME64_1;
+}
+
+void XXH64_Update(XXH64_State *state, const void *input, size_t len)
+{
+    const unsigned char *p = (const unsigned char*)input;
+    const unsigned char *end = p + len;
+
+    if (input == NULL || len == 0)
+        return;
+
+    state->total_len += len;
+
+    /* not enough for a stripe yet, keep it for later */
+    if (state->memsize + len < 32) {
+        memcpy(state->mem + state->memsize, p, len);
+        state->memsize += (uint32_t)len;
+        return;
+    }
+
+    if (state->memsize > 0) {
+        memcpy(state->mem + state->memsize, p, 32 - state->memsize);
+        p += 32 - state->memsize;
+
+        state->v[0] = round64(state->v[0], read64(state->mem));
+        state->v[1] = round64(state->v[1], read64(state->mem + 8));
+        state->v[2] = round64(state->v[2], read64(state->mem + 16));
+        state->v[3] = round64(state->v[3], read64(state->mem + 24));
+        state->memsize = 0;
+    }
+
+    {
+        uint64_t v1 = state->v[0], v2 = state->v[1], v3 = state->v[2], v4 = state->v[3];
+
+        while (p + 32 <= end) {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        }
+
+        state->v[0] = v1;
+        state->v[1] = v2;
+        state->v[2] = v3;
+        state->v[3] = v4;
+    }
+
+    if (p < end) {
+        memcpy(state->mem, p, (size_t)(end - p));
+        state->memsize = (uint32_t)(end - p);
+    }
+}
+
+uint64_t XXH64_Digest(const XXH64_State *state)
+{
+    uint64_t h;
+
+    if (state->total_len >= 32) {
+        h = rotl64(state->v[0], 1) + rotl64(state->v[1], 7) + rotl64(state->v[2], 12) + rotl64(state->v[3], 18);
+        h = merge_round64(h, state->v[0]);
+        h = merge_round64(h, state->v[1]);
+        h = merge_round64(h, state->v[2]);
+        h = merge_round64(h, state->v[3]);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+
+    h += state->total_len;
+
+    return finalize64(h, state->mem, state->memsize);
+}